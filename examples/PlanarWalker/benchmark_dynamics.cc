@@ -0,0 +1,254 @@
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+#include <gflags/gflags.h>
+
+#include "drake/multibody/joints/floating_base_types.h"
+#include "drake/multibody/parsers/urdf_parser.h"
+#include "drake/multibody/rigid_body_tree.h"
+#include "drake/math/autodiff.h"
+#include "drake/math/autodiff_gradient.h"
+
+#include "systems/trajectory_optimization/dircon_position_data.h"
+#include "systems/trajectory_optimization/dircon_kinematic_data_set.h"
+#include "examples/PlanarWalker/planar_walker_dynamics.h"
+
+using Eigen::Vector3d;
+using Eigen::VectorXd;
+using Eigen::MatrixXd;
+using std::cout;
+using std::endl;
+
+DEFINE_int32(iterations, 10000, "Number of evaluations to time");
+
+// Heap allocation counter. Eigen allocates with malloc rather than operator
+// new, so malloc itself is interposed (glibc only; elsewhere no counts are
+// reported)
+static long allocation_count = 0;
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* malloc(size_t size) {
+  allocation_count++;
+  return __libc_malloc(size);
+}
+#endif
+
+/// Compares the RigidBodyTree mass matrix and bias term against the
+/// generated PlanarWalkerDynamics kernels, through
+/// DirconKinematicDataSet::updateData with dynamic and fixed sizes. The
+/// contact kinematics go through the tree in both cases.
+/// For AutoDiffXd, also compares mixed and full AutoDiff evaluation.
+/// Also times the inverse-dynamics update (residual evaluation, with vdot
+/// as an input) against the forward dynamics solve, and the velocity to qdot
+/// mapping for fixed and floating base models, and the partial updates
+/// requested by each constraint type, with the heap allocations per update
+namespace drake{
+namespace dircon {
+
+void seed(const VectorXd& x, VectorXd* x_t) {
+  *x_t = x;
+}
+
+void seed(const VectorXd& x, AutoDiffVecXd* x_t) {
+  *x_t = math::initializeAutoDiff(x);
+}
+
+template <typename T, typename DataSet>
+double timeUpdateData(DataSet* data, const VectorX<T>& x,
+    const VectorX<T>& u, const VectorX<T>& l, int flags = kEvalAll) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    data->updateData(x, u, l, flags);
+  }
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = finish - start;
+  return elapsed.count()/FLAGS_iterations;
+}
+
+template <typename T, typename DataSet>
+double timeUpdateInverseDynamics(DataSet* data, const VectorX<T>& x, const VectorX<T>& vdot,
+    const VectorX<T>& u, const VectorX<T>& l) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    data->updateInverseDynamics(x, vdot, u, l);
+  }
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = finish - start;
+  return elapsed.count()/FLAGS_iterations;
+}
+
+template <typename T, typename DataSet>
+double allocationsPerUpdateData(DataSet* data, const VectorX<T>& x,
+    const VectorX<T>& u, const VectorX<T>& l, int flags = kEvalAll) {
+  const int iterations = 100;
+  const long start = allocation_count;
+  for (int i = 0; i < iterations; i++) {
+    data->updateData(x, u, l, flags);
+  }
+  return static_cast<double>(allocation_count - start)/iterations;
+}
+
+template <typename T>
+void runBenchmark(const RigidBodyTree<double>& tree, const std::string& name) {
+  int nq = tree.get_num_positions();
+  int nu = tree.get_num_actuators();
+
+  VectorXd x_val = VectorXd::Random(2*nq);
+  VectorXd u_val = VectorXd::Random(nu);
+  VectorXd l_val = VectorXd::Random(2);
+  VectorXd all(x_val.size() + u_val.size() + l_val.size());
+  all << x_val, u_val, l_val;
+  VectorX<T> all_t;
+  seed(all, &all_t);
+  VectorX<T> x = all_t.head(2*nq);
+  VectorX<T> u = all_t.segment(2*nq, nu);
+  VectorX<T> l = all_t.tail(2);
+
+  Vector3d pt;
+  pt << 0,0,-.5;
+  auto foot = DirconPositionData<T>(tree, tree.FindBodyIndex("left_lower_leg"), pt, true);
+  std::vector<DirconKinematicData<T>*> constraints;
+  constraints.push_back(&foot);
+  auto data = DirconKinematicDataSet<T>(tree, &constraints);
+
+  double tree_time = timeUpdateData(&data, x, u, l);
+  double tree_allocations = allocationsPerUpdateData(&data, x, u, l);
+  VectorX<T> xdot_tree = data.getXDot();
+
+  PlanarWalkerDynamics<T> generated(tree);
+  data.setDynamicsBackend(&generated);
+  double generated_time = timeUpdateData(&data, x, u, l);
+  double generated_allocations = allocationsPerUpdateData(&data, x, u, l);
+  VectorX<T> xdot_generated = data.getXDot();
+
+  auto fixed_data = DirconKinematicDataSet<T,6,6,2>(tree, &constraints);
+  fixed_data.setDynamicsBackend(&generated);
+  double fixed_time = timeUpdateData(&fixed_data, x, u, l);
+  double fixed_allocations = allocationsPerUpdateData(&fixed_data, x, u, l);
+  VectorX<T> xdot_fixed = fixed_data.getXDot();
+
+  // the contact kinematics go through the tree in all three
+  cout << name << " updateData (tree): " << 1e6*tree_time << " us, " << tree_allocations << " allocations" << endl;
+  cout << name << " updateData (generated M and C): " << 1e6*generated_time << " us, " <<
+      generated_allocations << " allocations" << endl;
+  cout << name << " updateData (generated M and C, fixed size): " << 1e6*fixed_time << " us, " <<
+      fixed_allocations << " allocations" << endl;
+  cout << name << " max xdot difference: " <<
+      (math::DiscardGradient(xdot_tree) - math::DiscardGradient(xdot_generated)).cwiseAbs().maxCoeff() << endl;
+  cout << name << " max xdot difference (fixed size): " <<
+      (math::DiscardGradient(xdot_tree) - math::DiscardGradient(xdot_fixed)).cwiseAbs().maxCoeff() << endl;
+
+  // partial updates, as requested by each constraint type
+  data.setDynamicsBackend(nullptr);
+  const std::vector<std::pair<std::string, int>> constraint_flags = {
+      {"kinematic (kAll)", kEvalAll},
+      {"kinematic (kAccelAndVel)", kEvalCDot | kEvalJdotv | kEvalDynamics},
+      {"kinematic (kAccelOnly)", kEvalJdotv | kEvalDynamics},
+      {"dynamic", kEvalJ | kEvalDynamics},
+      {"impact", kEvalJ}};
+  for (auto const& flags : constraint_flags) {
+    cout << name << " updateData (tree, " << flags.first << "): " <<
+        1e6*timeUpdateData(&data, x, u, l, flags.second) << " us, " <<
+        allocationsPerUpdateData(&data, x, u, l, flags.second) << " allocations" << endl;
+  }
+
+  // inverse dynamics at the forward solution, seeded in (x, u, l, vdot) as the
+  // inverse-dynamics constraints are
+  data.setDynamicsBackend(nullptr);
+  const VectorXd vdot_val = math::DiscardGradient(xdot_tree).tail(nq);
+  VectorXd all_inverse(all.size() + nq);
+  all_inverse << all, vdot_val;
+  VectorX<T> all_inverse_t;
+  seed(all_inverse, &all_inverse_t);
+  double inverse_time = timeUpdateInverseDynamics(&data, VectorX<T>(all_inverse_t.head(2*nq)),
+      VectorX<T>(all_inverse_t.tail(nq)), VectorX<T>(all_inverse_t.segment(2*nq, nu)),
+      VectorX<T>(all_inverse_t.segment(2*nq + nu, 2)));
+  cout << name << " updateInverseDynamics (tree): " << 1e6*inverse_time << " us" << endl;
+  cout << name << " max residual at the forward solution: " <<
+      math::DiscardGradient(data.getResidual()).cwiseAbs().maxCoeff() << endl;
+
+  if (std::is_same<T, AutoDiffXd>::value) {
+    // mixed mode (the default) against AutoDiff through the whole evaluation
+    data.setDynamicsBackend(nullptr);
+    data.setMixedAutoDiff(false);
+    double full_time = timeUpdateData(&data, x, u, l);
+    MatrixXd dxdot_full = math::autoDiffToGradientMatrix(data.getXDot());
+    data.setMixedAutoDiff(true);
+    timeUpdateData(&data, x, u, l);
+    MatrixXd dxdot_mixed = math::autoDiffToGradientMatrix(data.getXDot());
+
+    const double mixed_allocations = allocationsPerUpdateData(&data, x, u, l);
+    data.setMixedAutoDiff(false);
+    const double full_allocations = allocationsPerUpdateData(&data, x, u, l);
+    data.setMixedAutoDiff(true);
+    cout << name << " updateData (tree, full AutoDiff): " << 1e6*full_time << " us, " <<
+        full_allocations << " allocations" << endl;
+    cout << name << " updateData (tree, mixed AutoDiff): " << mixed_allocations << " allocations" << endl;
+    cout << name << " max xdot gradient difference (mixed vs full): " <<
+        (dxdot_mixed - dxdot_full).cwiseAbs().maxCoeff() << endl;
+  }
+}
+
+template <typename T>
+void benchmarkQDot(const RigidBodyTree<double>& tree, const std::string& name) {
+  const int nq = tree.get_num_positions();
+  const int nv = tree.get_num_velocities();
+  VectorX<T> q, v;
+  seed(VectorXd::Random(nq), &q);
+  seed(VectorXd::Random(nv), &v);
+  auto cache = tree.doKinematics(q, v);
+
+  std::vector<DirconKinematicData<T>*> constraints;
+  auto data = DirconKinematicDataSet<T>(tree, &constraints);
+
+  VectorX<T> qdot_dense, qdot_joints;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    qdot_dense = tree.GetVelocityToQDotMapping(cache)*v;
+  }
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> dense_time = finish - start;
+
+  start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    qdot_joints = tree.transformVelocityToQDot(cache, v);
+  }
+  finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> joint_time = finish - start;
+
+  cout << name << " (nq = " << nq << ", nv = " << nv << ", qdot = v: " <<
+      (data.isQDotIdentity() ? "yes" : "no") << ")" << endl;
+  cout << name << " dense mapping: " << 1e6*dense_time.count()/FLAGS_iterations << " us" << endl;
+  cout << name << " per-joint mapping: " << 1e6*joint_time.count()/FLAGS_iterations << " us" << endl;
+  cout << name << " max qdot difference: " <<
+      (math::DiscardGradient(qdot_dense) - math::DiscardGradient(qdot_joints)).cwiseAbs().maxCoeff() << endl;
+  if (data.isQDotIdentity()) {
+    cout << name << " max qdot difference from v: " <<
+        (math::DiscardGradient(qdot_dense) - math::DiscardGradient(v)).cwiseAbs().maxCoeff() << endl;
+  }
+}
+
+}
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  RigidBodyTree<double> tree;
+  drake::parsers::urdf::AddModelInstanceFromUrdfFileToWorld("PlanarWalker.urdf", drake::multibody::joints::kFixed, &tree);
+
+  drake::dircon::runBenchmark<double>(tree, "double");
+  drake::dircon::runBenchmark<drake::AutoDiffXd>(tree, "AutoDiffXd");
+
+  drake::dircon::benchmarkQDot<double>(tree, "PlanarWalker");
+  RigidBodyTree<double> acrobot;
+  drake::parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../Acrobot/Acrobot_floating.urdf", drake::multibody::joints::kFixed, &acrobot);
+  drake::dircon::benchmarkQDot<double>(acrobot, "Acrobot_floating");
+  drake::dircon::benchmarkQDot<drake::AutoDiffXd>(acrobot, "Acrobot_floating (AutoDiffXd)");
+  RigidBodyTree<double> acrobot_quaternion;
+  drake::parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../Acrobot/Acrobot_floating.urdf", drake::multibody::joints::kQuaternion, &acrobot_quaternion);
+  drake::dircon::benchmarkQDot<double>(acrobot_quaternion, "Acrobot_floating (quaternion base)");
+}
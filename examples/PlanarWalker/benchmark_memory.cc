@@ -0,0 +1,124 @@
+#include <memory>
+#include <chrono>
+
+#include <gflags/gflags.h>
+
+#include "drake/multibody/joints/floating_base_types.h"
+#include "drake/multibody/parsers/urdf_parser.h"
+#include "drake/multibody/rigid_body_tree.h"
+
+#include "systems/trajectory_optimization/dircon_util.h"
+#include "systems/trajectory_optimization/dircon_position_data.h"
+#include "systems/trajectory_optimization/dircon_kinematic_data_set.h"
+#include "systems/trajectory_optimization/hybrid_dircon.h"
+
+using Eigen::Vector3d;
+using Eigen::VectorXd;
+using Eigen::MatrixXd;
+using std::cout;
+using std::endl;
+
+DEFINE_int32(knots, 200, "Number of knot points per mode");
+DEFINE_int32(modes, 10, "Number of modes, alternating left and right stance");
+DEFINE_bool(running_cost, true, "Add the running costs of run_gait_dircon");
+DEFINE_bool(dense_linearization, false, "Also form the dense linearization of linearizeConstraints "
+            "(rows x num_vars doubles, which may not fit in memory)");
+
+/// Builds a PlanarWalker HybridDircon program of --modes modes with --knots
+/// knots each, and reports the memory held by the program by category
+/// (HybridDircon::GetMemoryUsage) together with the peak resident set size
+/// of the process after each stage. The sparse linearization of the
+/// constraints is compared with the dense one of linearizeConstraints.
+namespace drake{
+namespace dircon {
+
+using systems::trajectory_optimization::HybridDircon;
+using systems::trajectory_optimization::DirconOptions;
+using systems::trajectory_optimization::dircon::peakResidentSetSize;
+
+void printPeakRss(const std::string& stage) {
+  cout << "Peak RSS after " << stage << ": " << peakResidentSetSize()/1.0e6 << " MB" << endl;
+}
+
+void runBenchmark() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("PlanarWalker.urdf", multibody::joints::kFixed, &tree);
+  printPeakRss("loading the model");
+
+  Vector3d pt;
+  pt << 0,0,-.5;
+  Vector3d normal;
+  normal << 0,0,1;
+  auto leftFootConstraint = DirconPositionData<double>(tree, tree.FindBodyIndex("left_lower_leg"), pt, true);
+  auto rightFootConstraint = DirconPositionData<double>(tree, tree.FindBodyIndex("right_lower_leg"), pt, true);
+  leftFootConstraint.addFixedNormalFrictionConstraints(normal, 1);
+  rightFootConstraint.addFixedNormalFrictionConstraints(normal, 1);
+  std::vector<DirconKinematicData<double>*> leftConstraints = {&leftFootConstraint};
+  std::vector<DirconKinematicData<double>*> rightConstraints = {&rightFootConstraint};
+  auto leftDataSet = DirconKinematicDataSet<double>(tree, &leftConstraints);
+  auto rightDataSet = DirconKinematicDataSet<double>(tree, &rightConstraints);
+
+  auto options = DirconOptions(leftDataSet.countConstraints());
+  options.setConstraintRelative(0, true);
+
+  std::vector<int> timesteps;
+  std::vector<double> min_dt;
+  std::vector<double> max_dt;
+  std::vector<DirconKinematicDataSet<double>*> dataset_list;
+  std::vector<DirconOptions> options_list;
+  for (int i = 0; i < FLAGS_modes; i++) {
+    timesteps.push_back(FLAGS_knots);
+    min_dt.push_back(.01);
+    max_dt.push_back(.3);
+    dataset_list.push_back(i % 2 ? &rightDataSet : &leftDataSet);
+    options_list.push_back(options);
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto trajopt = std::make_shared<HybridDircon<double>>(tree, timesteps, min_dt, max_dt, dataset_list, options_list);
+  if (FLAGS_running_cost) {
+    const double R = 10;
+    auto u = trajopt->input();
+    trajopt->AddRunningCost(u.transpose()*R*u);
+    const double Q = 1;
+    auto x = trajopt->state();
+    trajopt->AddRunningCost(x.transpose()*Q*x);
+  }
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = finish - start;
+  cout << FLAGS_modes << " modes x " << FLAGS_knots << " knots: " << trajopt->num_vars() << " variables, " <<
+      trajopt->generic_constraints().size() << " generic constraints, built in " << elapsed.count() << " s" << endl;
+  printPeakRss("building the program");
+
+  size_t total = 0;
+  for (auto const& category : trajopt->GetMemoryUsage()) {
+    cout << "  " << category.first << ": " << category.second/1.0e6 << " MB" << endl;
+    total += category.second;
+  }
+  cout << "  total: " << total/1.0e6 << " MB" << endl;
+
+  const VectorXd z = VectorXd::Random(trajopt->num_vars());
+  systems::trajectory_optimization::dircon::SparseLinearization linearization(trajopt.get());
+  linearization.update(z);
+  cout << "Linearization: " << linearization.num_constraints() << " rows, " << linearization.num_nonzeros() <<
+      " nonzeros. Sparse Jacobian: " << linearization.num_nonzeros()*(sizeof(double) + 2*sizeof(int))/1.0e6 <<
+      " MB, dense Jacobian: " << 1.0*linearization.num_constraints()*trajopt->num_vars()*sizeof(double)/1.0e6 <<
+      " MB" << endl;
+  printPeakRss("the sparse linearization");
+
+  if (FLAGS_dense_linearization) {
+    VectorXd x = z;
+    VectorXd y, lb, ub;
+    MatrixXd A;
+    systems::trajectory_optimization::dircon::linearizeConstraints(trajopt.get(), x, y, A, lb, ub);
+    printPeakRss("the dense linearization");
+  }
+}
+
+}
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  drake::dircon::runBenchmark();
+}
@@ -1,5 +1,6 @@
 #include <memory>
 #include <chrono>
+#include <fstream>
 
 #include <gflags/gflags.h>
 
@@ -18,11 +19,13 @@
 #include "drake/solvers/constraint.h"
 
 #include "systems/trajectory_optimization/dircon_util.h"
+#include "systems/trajectory_optimization/dircon_presolve.h"
 
 #include "systems/trajectory_optimization/dircon_position_data.h"
 #include "systems/trajectory_optimization/dircon_kinematic_data_set.h"
 #include "systems/trajectory_optimization/hybrid_dircon.h"
 #include "systems/trajectory_optimization/dircon_opt_constraints.h"
+#include "systems/trajectory_optimization/dircon_trace.h"
 
 using Eigen::Vector3d;
 using Eigen::VectorXd;
@@ -41,6 +44,13 @@ using std::endl;
 
 DEFINE_double(strideLength, 0.1, "The stride length.");
 DEFINE_double(duration, 1, "The stride duration");
+DEFINE_bool(presolve, false, "Eliminate fixed and aliased variables before solving");
+DEFINE_bool(scale, false, "With --presolve, also scale the variables and constraints");
+DEFINE_bool(inverse_dynamics, false, "Use the inverse-dynamics formulation in both modes");
+DEFINE_string(trace_file, "", "Write a Chrome trace of the construction and solve to this file "
+              "(requires a build with DIRCON_ENABLE_TRACING)");
+DEFINE_string(statistics_file, "", "Write the per-binding evaluation counts and times of the solve "
+              "to this CSV file");
 
 /// Inputs: initial trajectory
 /// Outputs: trajectory optimization problem
@@ -119,6 +129,12 @@ shared_ptr<HybridDircon<double>> runDircon(double stride_length, double duration
   auto rightOptions = DirconOptions(rightDataSet.countConstraints());
   rightOptions.setConstraintRelative(0,true);
 
+  leftOptions.setInverseDynamics(FLAGS_inverse_dynamics);
+  rightOptions.setInverseDynamics(FLAGS_inverse_dynamics);
+
+  leftOptions.setEvaluationStatistics(!FLAGS_statistics_file.empty());
+  rightOptions.setEvaluationStatistics(!FLAGS_statistics_file.empty());
+
   std::vector<int> timesteps;
   timesteps.push_back(10);
   timesteps.push_back(10);
@@ -137,6 +153,9 @@ shared_ptr<HybridDircon<double>> runDircon(double stride_length, double duration
   options_list.push_back(leftOptions);
   options_list.push_back(rightOptions);
 
+  if (!FLAGS_trace_file.empty()) {
+    DirconTrace::start();
+  }
   auto trajopt = std::make_shared<HybridDircon<double>>(tree, timesteps, min_dt, max_dt, dataset_list, options_list);
 
   trajopt->AddDurationBounds(duration, duration);
@@ -165,20 +184,26 @@ shared_ptr<HybridDircon<double>> runDircon(double stride_length, double duration
   // hip_pindot-10
   // right_knee_pindot-11
   auto x0 = trajopt->initial_state();
-  auto xf = trajopt->final_state();
-
-  trajopt->AddLinearConstraint(x0(1) == xf(1));
-  trajopt->AddLinearConstraint(x0(2) + x0(4) == xf(2));
-  trajopt->AddLinearConstraint(x0(3) == xf(5));
-  trajopt->AddLinearConstraint(x0(4) == -xf(4));
-  trajopt->AddLinearConstraint(x0(5) == xf(3));
 
-  trajopt->AddLinearConstraint(x0(6) == xf(6));
-  trajopt->AddLinearConstraint(x0(7) == xf(7));
-  trajopt->AddLinearConstraint(x0(8) + x0(10) == xf(8));
-  trajopt->AddLinearConstraint(x0(9) == xf(11));
-  trajopt->AddLinearConstraint(x0(10) == -xf(10));
-  trajopt->AddLinearConstraint(x0(11) == xf(9));
+  // xf = M*x0 + offset: the legs swap, the hip angle flips, the body pitch
+  // picks up the hip angle, and the body advances by the stride length
+  MatrixXd periodicity_map = MatrixXd::Zero(12, 12);
+  for (int i : {0, 1, 6, 7}) {
+    periodicity_map(i, i) = 1;
+  }
+  periodicity_map(2, 2) = 1;
+  periodicity_map(2, 4) = 1;
+  periodicity_map(3, 5) = 1;
+  periodicity_map(4, 4) = -1;
+  periodicity_map(5, 3) = 1;
+  periodicity_map(8, 8) = 1;
+  periodicity_map(8, 10) = 1;
+  periodicity_map(9, 11) = 1;
+  periodicity_map(10, 10) = -1;
+  periodicity_map(11, 9) = 1;
+  VectorXd periodicity_offset = VectorXd::Zero(12);
+  periodicity_offset(0) = stride_length;
+  trajopt->AddPeriodicityConstraint(periodicity_map, periodicity_offset);
 
   // Knee joint limits
   auto x = trajopt->state();
@@ -187,7 +212,6 @@ shared_ptr<HybridDircon<double>> runDircon(double stride_length, double duration
 
   //Hip constraints
   trajopt->AddLinearConstraint(x0(0) == 0);
-  trajopt->AddLinearConstraint(xf(0) == stride_length);
 
   const double R = 10;  // Cost on input effort
   auto u = trajopt->input();
@@ -197,30 +221,49 @@ shared_ptr<HybridDircon<double>> runDircon(double stride_length, double duration
 
 
   auto start = std::chrono::high_resolution_clock::now();
-  auto result = trajopt->Solve();
+  solvers::SolutionResult result;
+  double cost;
+  if (FLAGS_presolve) {
+    systems::trajectory_optimization::DirconPresolve presolve(trajopt.get(), FLAGS_scale);
+    presolve.reduced_program()->SetSolverOption(drake::solvers::SnoptSolver::id(), "Print file","snopt.out");
+    presolve.reduced_program()->SetSolverOption(drake::solvers::SnoptSolver::id(), "Major iterations limit",200);
+    std::cout << "Presolve: " << presolve.num_original_vars() << " -> " << presolve.num_reduced_vars() <<
+        " variables, " << presolve.num_eliminated_rows() << " linear rows eliminated" << std::endl;
+    result = presolve.Solve();
+    cost = presolve.reduced_program()->GetOptimalCost();
+  } else {
+    result = trajopt->Solve();
+    cost = trajopt->GetOptimalCost();
+  }
   auto finish = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsed = finish - start;
+  if (!FLAGS_trace_file.empty() && !DirconTrace::stop(FLAGS_trace_file)) {
+    std::cerr << "Could not write " << FLAGS_trace_file << std::endl;
+  }
+  if (!FLAGS_statistics_file.empty()) {
+    std::ofstream statistics_file(FLAGS_statistics_file);
+    trajopt->WriteEvaluationStatisticsCsv(statistics_file);
+  }
   trajopt->PrintSolution();
   std::cout << "Solve time:" << elapsed.count() <<std::endl;
   std::cout << result << std::endl;
-  std::cout << "Cost:" << trajopt->GetOptimalCost() <<std::endl;
+  std::cout << "Cost:" << cost <<std::endl;
 
   systems::trajectory_optimization::dircon::checkConstraints(trajopt.get());
 
-  MatrixXd A;
-  VectorXd y,lb,ub;
+  // sparse, as the dense Jacobian of linearizeConstraints is rows x num_vars
   VectorXd x_sol = trajopt->GetSolution(trajopt->decision_variables());
-  systems::trajectory_optimization::dircon::linearizeConstraints(trajopt.get(),
-    x_sol, y, A, lb, ub);
+  systems::trajectory_optimization::dircon::SparseLinearization linearization(trajopt.get());
+  linearization.update(x_sol);
 
-//  MatrixXd y_and_bounds(y.size(),3);
-//  y_and_bounds.col(0) = lb;
-//  y_and_bounds.col(1) = y;
-//  y_and_bounds.col(2) = ub;
+//  MatrixXd y_and_bounds(linearization.num_constraints(),3);
+//  y_and_bounds.col(0) = linearization.lb();
+//  y_and_bounds.col(1) = linearization.y();
+//  y_and_bounds.col(2) = linearization.ub();
 //  cout << "*************y***************" << endl;
 //  cout << y_and_bounds << endl;
 //  cout << "*************A***************" << endl;
-//  cout << A << endl;
+//  cout << linearization.jacobian() << endl;
 
   //visualizer
   lcm::DrakeLcm lcm;
@@ -71,7 +71,8 @@ DirconContactData<T>::~DirconContactData() {
 }
 
 template <typename T>
-void DirconContactData<T>::updateConstraint(KinematicsCache<T>& cache) {
+void DirconContactData<T>::updateConstraint(KinematicsCache<T>& cache, int flags) {
+  // computes every quantity, regardless of flags
   VectorXd q_double = math::DiscardGradient(cache.getQ());
   KinematicsCache<double> cache_double = this->tree_->doKinematics(q_double);
 
@@ -23,7 +23,7 @@ class DirconContactData : public DirconKinematicData<T> {
     ~DirconContactData();
 
     //The workhorse function, updates and caches everything needed by the outside world
-    void updateConstraint(KinematicsCache<T>& cache);
+    void updateConstraint(KinematicsCache<T>& cache, int flags = kEvalAll);
 
   private:
     double mu_;
@@ -5,6 +5,7 @@
 #include "dircon_options.h"
 #include "dircon_kinematic_data.h"
 #include "dircon_kinematic_data_set.h"
+#include "hybrid_dircon.h"
 #include "drake/common/drake_copyable.h"
 #include "drake/solvers/constraint.h"
 #include "drake/systems/framework/context.h"
@@ -33,11 +34,13 @@ using trajectories::PiecewisePolynomial;
 /// and corresponding acceleration, velocity, and position constraints.
 
 template <typename T>
-class Dircon : public MultipleShooting {
+class Dircon : public HybridDircon<T> {
  public:
   DRAKE_NO_COPY_NO_MOVE_NO_ASSIGN(Dircon)
 
   /// Constructs the %MathematicalProgram% and adds the collocation constraints.
+  /// This is a single-mode HybridDircon, except that the timesteps are not
+  /// constrained to be equal.
   ///
   /// @param tree The RigidBodyTree describing the plant and kinematics
   /// @param num_time_samples The number of knot points in the trajectory.
@@ -50,16 +53,6 @@ class Dircon : public MultipleShooting {
 
   ~Dircon() override {}
 
-  /// Get the input trajectory at the solution as a
-  /// %PiecewisePolynomialTrajectory%.
-  PiecewisePolynomial<double> ReconstructInputTrajectory()
-  const override;
-
-  /// Get the state trajectory at the solution as a
-  /// %PiecewisePolynomialTrajectory%.
-  PiecewisePolynomial<double> ReconstructStateTrajectory()
-  const override;
-
   /// Set the initial guess
   /// @param traj_init_u control input u
   /// @param traj_init_x stat ex
@@ -70,34 +63,25 @@ class Dircon : public MultipleShooting {
                             const PiecewisePolynomial<double>& traj_init_l, const PiecewisePolynomial<double>& traj_init_lc,
                             const PiecewisePolynomial<double>& traj_init_vc);
 
+  using MultipleShooting::SetInitialTrajectory;
 
+  int num_kinematic_constraints() const { return HybridDircon<T>::num_kinematic_constraints(0); }
 
-  int num_kinematic_constraints() const { return num_kinematic_constraints_; }
-
-  const solvers::VectorXDecisionVariable& force_vars() const { return force_vars_; }
+  const solvers::VectorXDecisionVariable& force_vars() const { return HybridDircon<T>::force_vars(0); }
 
-  const solvers::VectorXDecisionVariable& offset_vars() const { return offset_vars_; }
+  const solvers::VectorXDecisionVariable& offset_vars() const { return HybridDircon<T>::offset_vars(0); }
 
-  const solvers::VectorXDecisionVariable& collocation_force_vars() const { return collocation_force_vars_; }
-
-  const solvers::VectorXDecisionVariable& collocation_slack_vars() const { return collocation_slack_vars_; }
+  const solvers::VectorXDecisionVariable& collocation_force_vars() const {
+    return HybridDircon<T>::collocation_force_vars(0);
+  }
 
-  Eigen::VectorBlock<const solvers::VectorXDecisionVariable> force(
-      int index) const {
-    DRAKE_DEMAND(index >= 0 && index < N());
-    return force_vars_.segment(index * num_kinematic_constraints_, num_kinematic_constraints_);
+  const solvers::VectorXDecisionVariable& collocation_slack_vars() const {
+    return HybridDircon<T>::collocation_slack_vars(0);
   }
 
- private:
-  // Implements a running cost at all timesteps using trapezoidal integration.
-  const RigidBodyTree<double>* tree_;
-  DirconKinematicDataSet<T>* constraints_;
-  void DoAddRunningCost(const symbolic::Expression& e) override;
-  const solvers::VectorXDecisionVariable force_vars_;
-  const solvers::VectorXDecisionVariable collocation_force_vars_;
-  const solvers::VectorXDecisionVariable collocation_slack_vars_;
-  const solvers::VectorXDecisionVariable offset_vars_;
-  const int num_kinematic_constraints_;
+  Eigen::VectorBlock<const solvers::VectorXDecisionVariable> force(int index) const {
+    return HybridDircon<T>::force(0, index);
+  }
 };
 
 }  // namespace trajectory_optimization
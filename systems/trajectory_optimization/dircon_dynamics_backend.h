@@ -0,0 +1,33 @@
+#pragma once
+
+#include "drake/common/eigen_types.h"
+
+namespace drake {
+
+/// Interface for replacing the RigidBodyTree mass matrix and bias
+/// computations in DirconKinematicDataSet.
+/// Implementations are typically generated offline for a single robot
+/// (see tools/dircon_codegen.py), using fixed-size matrices and constant
+/// joint geometry, and must use the same coordinate ordering as the tree.
+/// Only M and C are replaced: doKinematics and the contact kinematics (c, J,
+/// Jdot*v) of the DirconKinematicData still go through the tree.
+///
+/// The results are written into storage provided by the caller, which is
+/// sized and may be fixed-size (Eigen::Ref binds to both), so that a
+/// fixed-size implementation does not allocate.
+template <typename T>
+class DirconDynamicsBackend {
+  public:
+    virtual ~DirconDynamicsBackend() {}
+
+    /// The mass matrix M(q), written into the num_velocities square @p M
+    virtual void massMatrix(const Eigen::Ref<const VectorX<T>>& q, Eigen::Ref<MatrixX<T>> M) = 0;
+
+    /// The bias term C(q,v), including gravity and joint damping, matching
+    /// RigidBodyTree::dynamicsBiasTerm with no external wrenches, written
+    /// into @p bias
+    virtual void dynamicsBiasTerm(const Eigen::Ref<const VectorX<T>>& q, const Eigen::Ref<const VectorX<T>>& v,
+                                  Eigen::Ref<VectorX<T>> bias) = 0;
+};
+
+}
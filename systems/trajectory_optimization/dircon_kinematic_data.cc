@@ -17,22 +17,22 @@ template <typename T>
 DirconKinematicData<T>::~DirconKinematicData() {}
 
 template <typename T>
-VectorX<T> DirconKinematicData<T>::getC() {
+const VectorX<T>& DirconKinematicData<T>::getC() {
   return c_;
 }
 
 template <typename T>
-VectorX<T> DirconKinematicData<T>::getCDot() {
+const VectorX<T>& DirconKinematicData<T>::getCDot() {
   return cdot_;
 }
 
 template <typename T>
-MatrixX<T> DirconKinematicData<T>::getJ() {
+const MatrixX<T>& DirconKinematicData<T>::getJ() {
   return J_;
 }
 
 template <typename T>
-VectorX<T> DirconKinematicData<T>::getJdotv() {
+const VectorX<T>& DirconKinematicData<T>::getJdotv() {
   return Jdotv_;
 }
 
@@ -8,6 +8,19 @@
 #include "drake/multibody/kinematics_cache.h"
 namespace drake {
 
+/// Quantities to compute in an update, combined as a bitmask. cdot = J*v, so
+/// kEvalCDot also computes J. kEvalDynamics is used by
+/// DirconKinematicDataSet for the dynamics terms, and is ignored by
+/// DirconKinematicData.
+enum DirconEvalFlags {
+  kEvalC = 1,
+  kEvalJ = 2,
+  kEvalCDot = 4,
+  kEvalJdotv = 8,
+  kEvalDynamics = 16,
+  kEvalAll = 31
+};
+
 template <typename T>
 class DirconKinematicData {
   public:
@@ -15,12 +28,16 @@ class DirconKinematicData {
     ~DirconKinematicData();
 
     //The workhorse function, updates and caches everything needed by the outside world
-    virtual void updateConstraint(KinematicsCache<T>& cache) = 0;
+    //Only the quantities in flags (see DirconEvalFlags) need to be updated.
+    //kEvalJdotv requires a cache computed with the Jdot*v terms
+    virtual void updateConstraint(KinematicsCache<T>& cache, int flags = kEvalAll) = 0;
 
-    VectorX<T> getC();
-    VectorX<T> getCDot();
-    MatrixX<T> getJ();
-    VectorX<T> getJdotv();
+    // returned by reference: copying an AutoDiffXd vector allocates the
+    // derivatives of every entry
+    const VectorX<T>& getC();
+    const VectorX<T>& getCDot();
+    const MatrixX<T>& getJ();
+    const VectorX<T>& getJdotv();
     int getLength();
     int numForceConstraints();
     std::shared_ptr<solvers::Constraint> getForceConstraint(int index);
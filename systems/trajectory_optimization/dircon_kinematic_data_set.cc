@@ -1,16 +1,17 @@
 #include "dircon_kinematic_data_set.h"
+#include "dircon_trace.h"
 #include "drake/math/autodiff.h"
 #include "drake/math/autodiff_gradient.h"
 
 #include <chrono>
 
 namespace drake{
-template <typename T>
-DirconKinematicDataSet<T>::DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints) :
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints) :
   DirconKinematicDataSet(tree,constraints, tree.get_num_positions(), tree.get_num_velocities()) {}
 
-template <typename T>
-DirconKinematicDataSet<T>::DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints, int num_positions, int num_velocities): 
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints, int num_positions, int num_velocities):
   cache_(tree.CreateKinematicsCacheWithType<T>()) {
   tree_ = &tree;
 
@@ -22,97 +23,272 @@ DirconKinematicDataSet<T>::DirconKinematicDataSet(const RigidBodyTree<double>& t
   for (int i=0; i < constraints_->size(); i++) {
     constraint_count_ += (*constraints_)[i]->getLength();
   }
-  c_ = VectorX<T>(constraint_count_);
-  cdot_ = VectorX<T>(constraint_count_);
-  J_ = MatrixX<T>(constraint_count_,num_positions);
-  Jdotv_ = VectorX<T>(constraint_count_);
-  cddot_ = VectorX<T>(constraint_count_);
-  vdot_ = VectorX<T>(num_velocities_);
-  xdot_ = VectorX<T>(num_positions_ + num_velocities_);
-}
+  DRAKE_DEMAND(kNumPositions == Eigen::Dynamic || kNumPositions == num_positions_);
+  DRAKE_DEMAND(kNumVelocities == Eigen::Dynamic || kNumVelocities == num_velocities_);
+  DRAKE_DEMAND(kNumConstraints == Eigen::Dynamic || kNumConstraints == constraint_count_);
 
+  // resize() is a no-op for the fixed-size instantiations
+  c_.resize(constraint_count_);
+  cdot_.resize(constraint_count_);
+  J_.resize(constraint_count_,num_positions);
+  Jdotv_.resize(constraint_count_);
+  cddot_.resize(constraint_count_);
+  vdot_.resize(num_velocities_);
+  residual_.resize(num_velocities_);
+  M_.resize(num_velocities_, num_velocities_);
+  xdot_.resize(num_positions_ + num_velocities_);
 
-template <typename T>
-void DirconKinematicDataSet<T>::updateData(const VectorX<T>& state, const VectorX<T>& input, const VectorX<T>& forces) {
-  const VectorX<T> q = state.head(num_positions_);
-  const VectorX<T> v = state.tail(num_velocities_);
-  cache_ = tree_->doKinematics(q, v, true);
+  // Joints with as many positions as velocities (all but quaternion floating
+  // joints) have qdot = v
+  qdot_identity_ = num_positions_ == num_velocities_;
+  for (int i = 0; i < tree.get_num_bodies(); i++) {
+    const auto& body = tree.get_body(i);
+    if (body.has_parent_body() && body.getJoint().get_num_positions() != body.getJoint().get_num_velocities()) {
+      qdot_identity_ = false;
+    }
+  }
+}
 
-  int index = 0;
-  int n;
-  for (int i=0; i < constraints_->size(); i++) {
-    (*constraints_)[i]->updateConstraint(cache_);
 
-    n = (*constraints_)[i]->getLength();
-    c_.segment(index, n) = (*constraints_)[i]->getC();
-    cdot_.segment(index, n) = (*constraints_)[i]->getCDot();
-    J_.block(index, 0, n, num_positions_) = (*constraints_)[i]->getJ();
-    Jdotv_.segment(index, n) = (*constraints_)[i]->getJdotv();
-
-    index += n;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateData(const Eigen::Ref<const VectorX<T>>& state, const Eigen::Ref<const VectorX<T>>& input, const Eigen::Ref<const VectorX<T>>& forces, int flags) {
+  DIRCON_TRACE_SCOPE("DirconKinematicDataSet::updateData");
+  if (flags & kEvalDynamics) {
+    // J^T*lambda enters the dynamics
+    flags |= kEvalJ;
+  }
+  if (mixed_autodiff_) {
+    updateDataImpl(state, input, forces, flags, std::is_same<T, AutoDiffXd>());
+  } else {
+    updateDataImpl(state, input, forces, flags, std::false_type());
   }
+}
 
-  const MatrixX<T> M = tree_->massMatrix(cache_);
-  const typename RigidBodyTree<T>::BodyToWrenchMap no_external_wrenches;
-  const MatrixX<T> J_transpose = getJ().transpose();
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+template <typename U>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateDataImpl(const Eigen::Ref<const VectorX<U>>& state, const Eigen::Ref<const VectorX<U>>& input, const Eigen::Ref<const VectorX<U>>& forces, int flags, std::false_type) {
+  const PositionVector q = state.head(num_positions_);
+  const VelocityVector v = state.tail(num_velocities_);
+  updateKinematics(q, v, flags);
+  if (!(flags & kEvalDynamics)) {
+    updateMassMatrix(q);
+    return;
+  }
+  const VelocityVector bias = updateMassMatrixAndBias(q, v);
+  const Eigen::Matrix<T, kNumVelocities, kNumConstraints> J_transpose = J_.transpose();
 
   // right_hand_side is the right hand side of the system's equations:
   // M*vdot -J^T*f = right_hand_side.
-  VectorX<T> right_hand_side = -tree_->dynamicsBiasTerm(cache_, no_external_wrenches) + tree_->B*input + J_transpose*forces;
-  vdot_ = M.llt().solve(right_hand_side);
+  const VelocityVector right_hand_side = -bias + tree_->B*input + J_transpose*forces;
+  {
+    DIRCON_TRACE_SCOPE("llt");
+    vdot_ = M_.llt().solve(right_hand_side);
+  }
 
-  cddot_ = Jdotv_ + J_*vdot_;
+  if (flags & kEvalJdotv) {
+    cddot_ = Jdotv_ + J_*vdot_;
+  }
 
-  xdot_ << tree_->GetVelocityToQDotMapping(cache_)*v, vdot_; //assumes v = qdot
+  xdot_ << velocityToQDot(v), vdot_;
 }
 
-template <typename T>
-int DirconKinematicDataSet<T>::countConstraints() {
-  return constraint_count_;
+namespace {
+// Replaces derivatives with respect to (q,v) by derivatives with respect to
+// the incoming variables, given d(q,v)/d(incoming) = D
+template <typename Derived>
+void chainDerivatives(const Eigen::MatrixXd& D, Eigen::MatrixBase<Derived>* m) {
+  for (int j = 0; j < m->cols(); j++) {
+    for (int i = 0; i < m->rows(); i++) {
+      auto& derivatives = m->coeffRef(i,j).derivatives();
+      if (derivatives.size() == 0) {
+        derivatives = Eigen::VectorXd::Zero(D.cols());
+      } else {
+        derivatives = D.transpose()*derivatives;
+      }
+    }
+  }
 }
+}  // namespace
 
-template <typename T>
-int DirconKinematicDataSet<T>::getNumConstraintObjects() {
-  return constraints_->size();
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+template <typename U>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateDataImpl(const Eigen::Ref<const VectorX<U>>& state, const Eigen::Ref<const VectorX<U>>& input, const Eigen::Ref<const VectorX<U>>& forces, int flags, std::true_type) {
+  const int num_states = num_positions_ + num_velocities_;
+
+  // Incoming values and derivatives
+  int num_derivatives = 0;
+  for (int i = 0; i < state.size(); i++)
+    num_derivatives = std::max<int>(num_derivatives, state(i).derivatives().size());
+  for (int i = 0; i < input.size(); i++)
+    num_derivatives = std::max<int>(num_derivatives, input(i).derivatives().size());
+  for (int i = 0; i < forces.size(); i++)
+    num_derivatives = std::max<int>(num_derivatives, forces(i).derivatives().size());
+  const Eigen::VectorXd state_val = math::autoDiffToValueMatrix(state);
+  const Eigen::VectorXd input_val = math::autoDiffToValueMatrix(input);
+  const Eigen::VectorXd forces_val = math::autoDiffToValueMatrix(forces);
+  const Eigen::MatrixXd dstate = math::autoDiffToGradientMatrix(state, num_derivatives);
+  const Eigen::MatrixXd dinput = math::autoDiffToGradientMatrix(input, num_derivatives);
+  const Eigen::MatrixXd dforces = math::autoDiffToGradientMatrix(forces, num_derivatives);
+
+  // Kinematics and dynamics terms, seeded only in (q,v)
+  const VectorX<T> x_local = math::initializeAutoDiff(state_val);
+  const PositionVector q = x_local.head(num_positions_);
+  const VelocityVector v = x_local.tail(num_velocities_);
+  updateKinematics(q, v, flags);
+
+  // Only the terms computed in this update are chained
+  auto chainKinematics = [&]() {
+    if (flags & kEvalC)
+      chainDerivatives(dstate, &c_);
+    if (flags & kEvalCDot)
+      chainDerivatives(dstate, &cdot_);
+    if (flags & (kEvalJ | kEvalCDot))
+      chainDerivatives(dstate, &J_);
+    if (flags & kEvalJdotv)
+      chainDerivatives(dstate, &Jdotv_);
+    chainDerivatives(dstate, &M_);
+  };
+  if (!(flags & kEvalDynamics)) {
+    updateMassMatrix(q);
+    chainKinematics();
+    return;
+  }
+  const VelocityVector bias = updateMassMatrixAndBias(q, v);
+
+  const Eigen::MatrixXd M_val = math::autoDiffToValueMatrix(M_);
+  const Eigen::MatrixXd J_val = math::autoDiffToValueMatrix(J_);
+  DIRCON_TRACE_SCOPE("llt (mixed AutoDiff)");
+  const Eigen::LLT<Eigen::MatrixXd> M_llt = M_val.llt();
+  const Eigen::VectorXd vdot_val = M_llt.solve(-math::autoDiffToValueMatrix(bias) + tree_->B*input_val +
+                                               J_val.transpose()*forces_val);
+
+  // The (q,v) gradient of M*vdot = rhs, with vdot, u and lambda held fixed,
+  // gives M*d(vdot)/d(q,v)
+  const VelocityVector residual = -bias + (tree_->B*input_val).template cast<T>() +
+                                  J_.transpose()*forces_val.template cast<T>() - M_*vdot_val.template cast<T>();
+  const Eigen::MatrixXd dvdot = M_llt.solve(math::autoDiffToGradientMatrix(residual, num_states))*dstate +
+                                M_llt.solve(tree_->B)*dinput + M_llt.solve(J_val.transpose())*dforces;
+  math::initializeAutoDiffGivenGradientMatrix(vdot_val, dvdot, vdot_);
+
+  // cddot = Jdotv + J*vdot
+  if (flags & kEvalJdotv) {
+    const ConstraintVector cddot_fixed_vdot = Jdotv_ + J_*vdot_val.template cast<T>();
+    const Eigen::MatrixXd dcddot = math::autoDiffToGradientMatrix(cddot_fixed_vdot, num_states)*dstate + J_val*dvdot;
+    math::initializeAutoDiffGivenGradientMatrix(math::autoDiffToValueMatrix(cddot_fixed_vdot), dcddot, cddot_);
+  }
+
+  const PositionVector qdot = velocityToQDot(v);
+  Eigen::VectorXd xdot_val(num_states);
+  xdot_val << math::autoDiffToValueMatrix(qdot), vdot_val;
+  Eigen::MatrixXd dxdot(num_states, num_derivatives);
+  dxdot << math::autoDiffToGradientMatrix(qdot, num_states)*dstate, dvdot;
+  math::initializeAutoDiffGivenGradientMatrix(xdot_val, dxdot, xdot_);
+
+  chainKinematics();
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getC() {
-  return c_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateKinematics(const PositionVector& q, const VelocityVector& v, int flags) {
+  {
+    DIRCON_TRACE_SCOPE("doKinematics");
+    // the velocity terms of the cache are needed for Jdotv, and for the
+    // tree's dynamicsBiasTerm (inverseDynamics with velocity terms). Only
+    // the kinematic and impact updates skip them.
+    const bool velocity_terms = (flags & kEvalJdotv) || ((flags & kEvalDynamics) && !backend_);
+    cache_ = tree_->doKinematics(q, v, velocity_terms);
+  }
+
+  int index = 0;
+  int n;
+  for (int i=0; i < constraints_->size(); i++) {
+    (*constraints_)[i]->updateConstraint(cache_, flags);
+
+    n = (*constraints_)[i]->getLength();
+    if (flags & kEvalC)
+      c_.segment(index, n) = (*constraints_)[i]->getC();
+    if (flags & kEvalCDot)
+      cdot_.segment(index, n) = (*constraints_)[i]->getCDot();
+    if (flags & (kEvalJ | kEvalCDot))
+      J_.block(index, 0, n, num_positions_) = (*constraints_)[i]->getJ();
+    if (flags & kEvalJdotv)
+      Jdotv_.segment(index, n) = (*constraints_)[i]->getJdotv();
+
+    index += n;
+  }
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getCDot() {
-  return cdot_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+typename DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::PositionVector
+DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::velocityToQDot(const VelocityVector& v) {
+  if (qdot_identity_) {
+    return v;
+  }
+  // applies the mapping joint by joint, rather than forming the dense
+  // num_positions x num_velocities matrix
+  return tree_->transformVelocityToQDot(cache_, VectorX<T>(v));
 }
 
-template <typename T>
-MatrixX<T> DirconKinematicDataSet<T>::getJ() {
-  return J_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+typename DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::VelocityVector
+DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateMassMatrixAndBias(const PositionVector& q, const VelocityVector& v) {
+  updateMassMatrix(q);
+  DIRCON_TRACE_SCOPE("dynamicsBiasTerm");
+  if (backend_) {
+    VelocityVector bias(num_velocities_);
+    backend_->dynamicsBiasTerm(q, v, bias);
+    return bias;
+  }
+  const typename RigidBodyTree<T>::BodyToWrenchMap no_external_wrenches;
+  return tree_->dynamicsBiasTerm(cache_, no_external_wrenches);
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getJdotv() {
-  return Jdotv_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateMassMatrix(const PositionVector& q) {
+  DIRCON_TRACE_SCOPE("massMatrix");
+  if (backend_) {
+    backend_->massMatrix(q, M_);
+  } else {
+    M_ = tree_->massMatrix(cache_);
+  }
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getCDDot() {
-  return cddot_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+void DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::updateInverseDynamics(const Eigen::Ref<const VectorX<T>>& state, const Eigen::Ref<const VectorX<T>>& vdot, const Eigen::Ref<const VectorX<T>>& input, const Eigen::Ref<const VectorX<T>>& forces, int flags) {
+  DIRCON_TRACE_SCOPE("DirconKinematicDataSet::updateInverseDynamics");
+  if (flags & (kEvalDynamics | kEvalJdotv)) {
+    // J^T*lambda enters the residual, and J*vdot enters cddot
+    flags |= kEvalJ;
+  }
+  const PositionVector q = state.head(num_positions_);
+  const VelocityVector v = state.tail(num_velocities_);
+  updateKinematics(q, v, flags);
+  vdot_ = vdot;
+  if (flags & kEvalDynamics) {
+    const VelocityVector bias = updateMassMatrixAndBias(q, v);
+    residual_ = M_*vdot_ + bias - tree_->B*input - J_.transpose()*forces;
+  } else {
+    updateMassMatrix(q);
+  }
+
+  if (flags & kEvalJdotv) {
+    cddot_ = Jdotv_ + J_*vdot_;
+  }
+
+  xdot_ << velocityToQDot(v), vdot_;
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getVDot() {
-  return vdot_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+int DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::countConstraints() {
+  return constraint_count_;
 }
 
-template <typename T>
-VectorX<T> DirconKinematicDataSet<T>::getXDot() {
-  return xdot_;
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+int DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::getNumConstraintObjects() {
+  return constraints_->size();
 }
 
-template <typename T>
-DirconKinematicData<T>* DirconKinematicDataSet<T>::getConstraint(int index) {
+template <typename T, int kNumPositions, int kNumVelocities, int kNumConstraints>
+DirconKinematicData<T>* DirconKinematicDataSet<T, kNumPositions, kNumVelocities, kNumConstraints>::getConstraint(int index) {
   return (*constraints_)[index];
 }
 
@@ -121,4 +297,9 @@ DirconKinematicData<T>* DirconKinematicDataSet<T>::getConstraint(int index) {
 template class DirconKinematicDataSet<double>;
 template class DirconKinematicDataSet<AutoDiffXd>;
 
+// Fixed-size instantiations for the PlanarWalker example (one foot in
+// contact). Add a double and AutoDiffXd pair here for other robots.
+template class DirconKinematicDataSet<double, 6, 6, 2>;
+template class DirconKinematicDataSet<AutoDiffXd, 6, 6, 2>;
+
 }
\ No newline at end of file
@@ -1,36 +1,121 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
 
 #include "dircon_kinematic_data.h"
+#include "dircon_dynamics_backend.h"
 #include <gflags/gflags.h>
 #include "drake/multibody/rigid_body_tree.h"
 #include "drake/multibody/kinematics_cache.h"
 
 namespace drake{
-template <typename T>
+
+/// Collects a set of DirconKinematicData and computes the constrained
+/// dynamics. The optional size parameters fix the number of positions,
+/// velocities and kinematic constraints at compile time, so that all storage
+/// and intermediate matrices (including the mass matrix factorization) are
+/// fixed-size and stack allocated. They must match the tree and constraints.
+/// The defaults give the dynamic-size class used by the optimization
+/// constraints.
+///
+/// The definitions live in dircon_kinematic_data_set.cc, which explicitly
+/// instantiates the dynamic-size class and <6, 6, 2> (PlanarWalker, one foot
+/// in contact), for double and AutoDiffXd. Other sizes are added as a pair of
+/// lines there, e.g.
+///   template class DirconKinematicDataSet<double, 14, 14, 4>;
+///   template class DirconKinematicDataSet<AutoDiffXd, 14, 14, 4>;
+/// The fixed-size class holds fixed-size vectorizable Eigen members, so it
+/// must be heap allocated with new (which is aligned) rather than
+/// std::make_shared, and kept out of std containers without
+/// Eigen::aligned_allocator.
+template <typename T, int kNumPositions = Eigen::Dynamic, int kNumVelocities = Eigen::Dynamic,
+          int kNumConstraints = Eigen::Dynamic>
 class DirconKinematicDataSet {
   public:
+    static constexpr int kNumStates = (kNumPositions == Eigen::Dynamic || kNumVelocities == Eigen::Dynamic) ?
+        Eigen::Dynamic : kNumPositions + kNumVelocities;
+
+    typedef Eigen::Matrix<T, kNumConstraints, 1> ConstraintVector;
+    typedef Eigen::Matrix<T, kNumConstraints, kNumPositions> ConstraintJacobian;
+    typedef Eigen::Matrix<T, kNumPositions, 1> PositionVector;
+    typedef Eigen::Matrix<T, kNumVelocities, 1> VelocityVector;
+    typedef Eigen::Matrix<T, kNumStates, 1> StateVector;
+    typedef Eigen::Matrix<T, kNumVelocities, kNumVelocities> MassMatrix;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
     DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints);
 
-    void updateData(const VectorX<T>& state, const VectorX<T>& input, const VectorX<T>& forces);
+    /// Updates the kinematic terms and the constrained dynamics.
+    /// @param flags the quantities needed by the caller (see DirconEvalFlags).
+    ///   With kEvalDynamics, J, vdot and xdot are computed, and cddot if
+    ///   kEvalJdotv is also set. Without it, only the mass matrix is updated
+    ///   beyond the requested kinematic terms. Quantities not requested keep
+    ///   their values from an earlier update.
+    void updateData(const Eigen::Ref<const VectorX<T>>& state, const Eigen::Ref<const VectorX<T>>& input, const Eigen::Ref<const VectorX<T>>& forces, int flags = kEvalAll);
+
+    /// Inverse-dynamics update, with vdot given instead of solved for. Computes
+    /// the kinematic terms and the dynamics residual
+    ///   M*vdot + C - B*u - J^T*lambda,
+    /// avoiding the mass matrix factorization. getVDot(), getCDDot() and
+    /// getXDot() are computed from the given vdot. The flags are as for
+    /// updateData, with kEvalDynamics giving the residual.
+    void updateInverseDynamics(const Eigen::Ref<const VectorX<T>>& state, const Eigen::Ref<const VectorX<T>>& vdot, const Eigen::Ref<const VectorX<T>>& input,
+                               const Eigen::Ref<const VectorX<T>>& forces, int flags = kEvalAll);
 
-    VectorX<T> getC();
-    VectorX<T> getCDot();
-    MatrixX<T> getJ();
-    VectorX<T> getJdotv();
-    VectorX<T> getCDDot();
-    VectorX<T> getVDot();
-    VectorX<T> getXDot();
+    const ConstraintVector& getC() { return c_; };
+    const ConstraintVector& getCDot() { return cdot_; };
+    const ConstraintJacobian& getJ() { return J_; };
+    const ConstraintVector& getJdotv() { return Jdotv_; };
+    const ConstraintVector& getCDDot() { return cddot_; };
+    const VelocityVector& getVDot() { return vdot_; };
+    const StateVector& getXDot() { return xdot_; };
+    const MassMatrix& getM() { return M_; };
+    /// The dynamics residual from the last updateInverseDynamics()
+    const VelocityVector& getResidual() { return residual_; };
 
     DirconKinematicData<T>* getConstraint(int index);
 
     KinematicsCache<T>* getCache() { return &cache_; };
 
+    /// Use @p backend for the mass matrix and bias term instead of the tree.
+    /// The backend is not owned, and nullptr restores the tree computations.
+    void setDynamicsBackend(DirconDynamicsBackend<T>* backend) { backend_ = backend; };
+
+    /// With T = AutoDiffXd, evaluate the kinematics and dynamics with
+    /// derivatives seeded only in (q,v), and add the input, force and
+    /// incoming-derivative dependence analytically (vdot is linear in u and
+    /// lambda, with coefficients M^{-1}*B and M^{-1}*J^T). This keeps the
+    /// derivative vectors inside the RigidBodyTree calls at length
+    /// num_positions + num_velocities. Enabled by default, and ignored for double.
+    void setMixedAutoDiff(bool mixed) { mixed_autodiff_ = mixed; };
+
+    /// True if every joint of the tree has qdot = v, in which case xdot is
+    /// formed by copying v rather than applying the velocity to qdot mapping
+    bool isQDotIdentity() const { return qdot_identity_; };
+
     int getNumConstraintObjects();
     int countConstraints();
 
   private:
+    template <typename U = T>
+    void updateDataImpl(const Eigen::Ref<const VectorX<U>>& state, const Eigen::Ref<const VectorX<U>>& input, const Eigen::Ref<const VectorX<U>>& forces, int flags,
+                        std::false_type);
+    template <typename U = T>
+    void updateDataImpl(const Eigen::Ref<const VectorX<U>>& state, const Eigen::Ref<const VectorX<U>>& input, const Eigen::Ref<const VectorX<U>>& forces, int flags,
+                        std::true_type);
+
+    // doKinematics, then the flagged terms among c, cdot, J and Jdotv from the
+    // constraint objects
+    void updateKinematics(const PositionVector& q, const VelocityVector& v, int flags);
+    // qdot for the current cache_, with the per-joint mapping only when needed
+    PositionVector velocityToQDot(const VelocityVector& v);
+    // M_, from the backend if set
+    void updateMassMatrix(const PositionVector& q);
+    // M_ and the returned bias term, from the backend if set
+    VelocityVector updateMassMatrixAndBias(const PositionVector& q, const VelocityVector& v);
+
     DirconKinematicDataSet(const RigidBodyTree<double>& tree, std::vector<DirconKinematicData<T>*>* constraints, int num_positions, int num_velocities);
 
     const RigidBodyTree<double>* tree_;
@@ -38,13 +123,18 @@ class DirconKinematicDataSet {
     int num_velocities_;
     int constraint_count_;
     std::vector<DirconKinematicData<T>*>* constraints_;
-    VectorX<T> c_;
-    VectorX<T> cdot_;
-    MatrixX<T> J_;
-    VectorX<T> Jdotv_;
-    VectorX<T> cddot_;
-    VectorX<T> vdot_;
-    VectorX<T> xdot_;
+    ConstraintVector c_;
+    ConstraintVector cdot_;
+    ConstraintJacobian J_;
+    ConstraintVector Jdotv_;
+    ConstraintVector cddot_;
+    VelocityVector vdot_;
+    StateVector xdot_;
+    MassMatrix M_;
+    VelocityVector residual_;
     KinematicsCache<T> cache_;
+    DirconDynamicsBackend<T>* backend_{nullptr};
+    bool mixed_autodiff_{true};
+    bool qdot_identity_{false};
 };
 }
\ No newline at end of file
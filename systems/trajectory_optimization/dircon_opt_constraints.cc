@@ -1,5 +1,9 @@
 #include "dircon_opt_constraints.h"
+#include "dircon_trace.h"
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
+#include <limits>
 #include <stdexcept>
 #include <utility>
 #include <vector>
@@ -19,6 +23,22 @@ using solvers::VectorXDecisionVariable;
 using Eigen::VectorXd;
 using Eigen::MatrixXd;
 
+namespace {
+
+size_t vectorBytes(const VectorXd& v) {
+  return v.size()*sizeof(double);
+}
+
+size_t vectorBytes(const AutoDiffVecXd& v) {
+  size_t bytes = v.size()*sizeof(AutoDiffXd);
+  for (int i = 0; i < v.size(); i++) {
+    bytes += v(i).derivatives().size()*sizeof(double);
+  }
+  return bytes;
+}
+
+}
+
 template <typename T>
 DirconAbstractConstraint<T>::DirconAbstractConstraint(int num_constraints, int num_vars,
                                                       const VectorXd& lb,
@@ -31,63 +51,143 @@ template <>
 void DirconAbstractConstraint<double>::DoEval(
     const Eigen::Ref<const Eigen::VectorXd>& x,
     Eigen::VectorXd& y) const {
+  DIRCON_TRACE_SCOPE("DirconAbstractConstraint::DoEval");
   EvaluateConstraint(x,y);
+  recordEvaluation(y);
 }
 
 template <>
 void DirconAbstractConstraint<AutoDiffXd>::DoEval(
     const Eigen::Ref<const Eigen::VectorXd>& x,
     Eigen::VectorXd& y) const {
+  DIRCON_TRACE_SCOPE("DirconAbstractConstraint::DoEval");
   AutoDiffVecXd y_t;
   EvaluateConstraint(math::initializeAutoDiff(x), y_t);
+  y = math::autoDiffToValueMatrix(y_t);
+  recordEvaluation(y);
 }
 
 template <>
 void DirconAbstractConstraint<AutoDiffXd>::DoEval(
     const Eigen::Ref<const AutoDiffVecXd>& x, AutoDiffVecXd& y) const {
+  DIRCON_TRACE_SCOPE("DirconAbstractConstraint::DoEval (AutoDiff)");
   EvaluateConstraint(x,y);
+  recordEvaluation(math::autoDiffToValueMatrix(y));
 }
 
 template <>
 void DirconAbstractConstraint<double>::DoEval(
     const Eigen::Ref<const AutoDiffVecXd>& x, AutoDiffVecXd& y) const {
-    // forward differencing
-    double dx = 1e-8;
-
-    VectorXd x_val = math::autoDiffToValueMatrix(x);
-    VectorXd y0,yi;
-    EvaluateConstraint(x_val,y0);
-
-    MatrixXd dy = MatrixXd(y0.size(),x_val.size());
-    for (int i=0; i < x_val.size(); i++) {
-      x_val(i) += dx;
-      EvaluateConstraint(x_val,yi);
-      x_val(i) -= dx;
-      dy.col(i) = (yi - y0)/dx;
+  DIRCON_TRACE_SCOPE("DirconAbstractConstraint::DoEval (finite difference)");
+  VectorXd x_val = math::autoDiffToValueMatrix(x);
+  VectorXd y0,yi,ym;
+  EvaluateConstraint(x_val,y0);
+
+  MatrixXd dy = MatrixXd(y0.size(),x_val.size());
+  switch (difference_type_) {
+    case kForwardDifference:
+      for (int i=0; i < x_val.size(); i++) {
+        x_val(i) += dx_;
+        EvaluateConstraint(x_val,yi);
+        x_val(i) -= dx_;
+        dy.col(i) = (yi - y0)/dx_;
+      }
+      break;
+    case kCentralDifference:
+      for (int i=0; i < x_val.size(); i++) {
+        x_val(i) -= dx_/2;
+        EvaluateConstraint(x_val,ym);
+        x_val(i) += dx_;
+        EvaluateConstraint(x_val,yi);
+        x_val(i) -= dx_/2;
+        dy.col(i) = (yi - ym)/dx_;
+      }
+      break;
+    case kScaledForwardDifference:
+      for (int i=0; i < x_val.size(); i++) {
+        const double xi = x_val(i);
+        x_val(i) += dx_*std::max(1.0, std::abs(xi));
+        // use the representable step actually taken
+        const double dxi = x_val(i) - xi;
+        EvaluateConstraint(x_val,yi);
+        x_val(i) = xi;
+        dy.col(i) = (yi - y0)/dxi;
+      }
+      break;
+  }
+
+  // chain rule with the incoming derivatives
+  MatrixXd dx_in = math::autoDiffToGradientMatrix(x);
+  if (dx_in.cols() > 0 && !(dx_in.rows() == dx_in.cols() && dx_in.isIdentity(0))) {
+    dy = dy*dx_in;
+  }
+  math::initializeAutoDiffGivenGradientMatrix(y0, dy, y);
+  recordEvaluation(y0);
+}
+
+template <typename T>
+void DirconAbstractConstraint<T>::recordEvaluation(const VectorXd& y) const {
+  if (solve_control_) {
+    double violation = 0;
+    if (y.size() > 0) {
+      violation = std::max(violation, std::max((lower_bound() - y).maxCoeff(), (y - upper_bound()).maxCoeff()));
+    }
+    solve_control_->recordEvaluation(violation);
+  }
+}
+
+template <typename T>
+void DirconAbstractConstraint<T>::setFiniteDifference(DirconFiniteDifferenceType type, double dx) {
+  difference_type_ = type;
+  if (dx > 0) {
+    dx_ = dx;
+  } else {
+    switch (type) {
+      case kForwardDifference:
+        dx_ = 1e-8;
+        break;
+      case kCentralDifference:
+        dx_ = 1e-6;
+        break;
+      case kScaledForwardDifference:
+        dx_ = std::sqrt(std::numeric_limits<double>::epsilon());
+        break;
     }
-    math::initializeAutoDiffGivenGradientMatrix(y0, dy, y);
-
-    // // central differencing
-    // double dx = 1e-8;
-
-    // VectorXd x_val = math::autoDiffToValueMatrix(x);
-    // VectorXd y0,yi;
-    // EvaluateConstraint(x_val,y0);
-
-    // MatrixXd dy = MatrixXd(y0.size(),x_val.size());
-    // for (int i=0; i < x_val.size(); i++) {
-    //   x_val(i) -= dx/2;
-    //   EvaluateConstraint(x_val,y0);
-    //   x_val(i) += dx;
-    //   EvaluateConstraint(x_val,yi);
-    //   x_val(i) -= dx/2;
-    //   dy.col(i) = (yi - y0)/dx;
-    // }
-    // EvaluateConstraint(x_val,y0);
-    // math::initializeAutoDiffGivenGradientMatrix(y0, dy, y);
+  }
 }
 
+template <>
+void DirconAbstractConstraint<AutoDiffXd>::EvalLagrangianHessian(
+    const Eigen::Ref<const VectorXd>& x, const Eigen::Ref<const VectorXd>& lambda,
+    MatrixXd* hessian) const {
+  DRAKE_ASSERT(lambda.size() == num_constraints());
+  // central differencing of the exact gradients of lambda^T y, with O(dx^2)
+  // truncation error
+  double dx = 1e-6;
+
+  AutoDiffVecXd x_val = math::initializeAutoDiff(x);
+  AutoDiffVecXd yp, ym;
+  hessian->resize(x.size(), x.size());
+  for (int i=0; i < x.size(); i++) {
+    x_val(i).value() += dx/2;
+    EvaluateConstraint(x_val, yp);
+    x_val(i).value() -= dx;
+    EvaluateConstraint(x_val, ym);
+    x_val(i).value() += dx/2;
+    hessian->col(i) = (math::autoDiffToGradientMatrix(yp) -
+        math::autoDiffToGradientMatrix(ym)).transpose()*lambda/dx;
+  }
+  *hessian = 0.5*(*hessian + hessian->transpose());
+}
 
+template <>
+void DirconAbstractConstraint<double>::EvalLagrangianHessian(
+    const Eigen::Ref<const VectorXd>& x, const Eigen::Ref<const VectorXd>& lambda,
+    MatrixXd* hessian) const {
+  // second differences of the values would cost O(num_vars^2) evaluations
+  // and be only roughly accurate
+  throw std::logic_error("DirconAbstractConstraint::EvalLagrangianHessian requires T = AutoDiffXd");
+}
 
 template <typename T>
 DirconDynamicConstraint<T>::DirconDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints) :
@@ -110,6 +210,7 @@ DirconDynamicConstraint<T>::DirconDynamicConstraint(const RigidBodyTree<double>&
 template <typename T>
 void DirconDynamicConstraint<T>::EvaluateConstraint(
     const Eigen::Ref<const VectorX<T>>& x, VectorX<T>& y) const {
+  DIRCON_TRACE_SCOPE("DirconDynamicConstraint::EvaluateConstraint");
   DRAKE_ASSERT(x.size() == 1 + (2 * num_states_) + (2 * num_inputs_) + 4*(num_kinematic_constraints_));
 
   // Extract our input variables:
@@ -126,22 +227,199 @@ void DirconDynamicConstraint<T>::EvaluateConstraint(
   const auto lc = x.segment(1 + 2 * (num_states_ + num_inputs_) + 2*num_kinematic_constraints_, num_kinematic_constraints_);
   const auto vc = x.segment(1 + 2 * (num_states_ + num_inputs_) + 3*num_kinematic_constraints_, num_kinematic_constraints_);
 
-  constraints_->updateData(x0, u0, l0);
-  const auto xdot0 = constraints_->getXDot();
-
-  constraints_->updateData(x1, u1, l1);
-  const auto xdot1 = constraints_->getXDot();
+  const auto xdot0 = knotXDot(0, x0, u0, l0);
+  const auto xdot1 = knotXDot(1, x1, u1, l1);
 
   // Cubic interpolation to get xcol and xdotcol.
   const auto xcol = 0.5 * (x0 + x1) + h / 8 * (xdot0 - xdot1);
   const auto xdotcol = -1.5 * (x0 - x1) / h - .25 * (xdot0 + xdot1);
 
-  constraints_->updateData(xcol, 0.5 * (u0 + u1), lc);
+  constraints_->updateData(xcol, 0.5 * (u0 + u1), lc, kEvalJ | kEvalDynamics);
   auto g = constraints_->getXDot();
   g.head(num_positions_) += constraints_->getJ().transpose()*vc;
   y = xdotcol - g;
 }
 
+template <typename T>
+size_t DirconDynamicConstraint<T>::getMemoryUsage() const {
+  return vectorBytes(knot_vars_[0]) + vectorBytes(knot_vars_[1]) +
+         vectorBytes(knot_xdot_[0]) + vectorBytes(knot_xdot_[1]);
+}
+
+template <typename T>
+const VectorX<T>& DirconDynamicConstraint<T>::knotXDot(int knot, const Eigen::Ref<const VectorX<T>>& state,
+    const Eigen::Ref<const VectorX<T>>& input, const Eigen::Ref<const VectorX<T>>& force) const {
+  // compared in place, to avoid building the concatenated vector on every call
+  VectorX<T>& vars = knot_vars_[knot];
+  const int num_vars = num_states_ + num_inputs_ + num_kinematic_constraints_;
+  if (vars.size() != num_vars || vars.head(num_states_) != state ||
+      vars.segment(num_states_, num_inputs_) != input || vars.tail(num_kinematic_constraints_) != force) {
+    constraints_->updateData(state, input, force, kEvalJ | kEvalDynamics);
+    vars.resize(num_vars);
+    vars << state, input, force;
+    knot_xdot_[knot] = constraints_->getXDot();
+  }
+  return knot_xdot_[knot];
+}
+
+// With AutoDiffXd, each updateData call is seeded only with the variables of
+// its own stage: (x0,u0,l0) at knot 0, (x1,u1,l1) at knot 1 and
+// (xcol,ucol,lc,vc) at the collocation point. The stage gradients are then
+// chain-ruled into the full gradient with double arithmetic, rather than
+// carrying derivatives in every constraint variable through all three calls.
+template <>
+void DirconDynamicConstraint<AutoDiffXd>::EvaluateConstraint(
+    const Eigen::Ref<const AutoDiffVecXd>& x, AutoDiffVecXd& y) const {
+  DIRCON_TRACE_SCOPE("DirconDynamicConstraint::EvaluateConstraint");
+  DRAKE_ASSERT(x.size() == 1 + (2 * num_states_) + (2 * num_inputs_) + 4*(num_kinematic_constraints_));
+
+  const int nx = num_states_;
+  const int nu = num_inputs_;
+  const int nl = num_kinematic_constraints_;
+  const int num_vars = x.size();
+
+  // Offsets of each block in the constraint variables
+  const int h_index = 0;
+  const int x0_index = 1;
+  const int x1_index = 1 + nx;
+  const int u0_index = 1 + 2*nx;
+  const int u1_index = 1 + 2*nx + nu;
+  const int l0_index = 1 + 2*(nx + nu);
+  const int l1_index = l0_index + nl;
+  const int lc_index = l0_index + 2*nl;
+  const int vc_index = l0_index + 3*nl;
+
+  const VectorXd x_val = math::autoDiffToValueMatrix(x);
+  const double h = x_val(h_index);
+  const VectorXd x0 = x_val.segment(x0_index, nx);
+  const VectorXd x1 = x_val.segment(x1_index, nx);
+  const VectorXd u0 = x_val.segment(u0_index, nu);
+  const VectorXd u1 = x_val.segment(u1_index, nu);
+
+  // Knot dynamics, seeded in (x, u, l) of the knot, and the gradient of
+  // xdot with respect to all constraint variables
+  auto knotDynamics = [&](int x_index, int u_index, int l_index, VectorXd* xdot, MatrixXd* dxdot) {
+    VectorXd z(nx + nu + nl);
+    z << x_val.segment(x_index, nx), x_val.segment(u_index, nu), x_val.segment(l_index, nl);
+    const AutoDiffVecXd z_autodiff = math::initializeAutoDiff(z);
+    constraints_->updateData(z_autodiff.head(nx), z_autodiff.segment(nx, nu), z_autodiff.tail(nl), kEvalJ | kEvalDynamics);
+    const auto& xdot_autodiff = constraints_->getXDot();
+    *xdot = math::autoDiffToValueMatrix(xdot_autodiff);
+    const MatrixXd dz = math::autoDiffToGradientMatrix(xdot_autodiff, z.size());
+    *dxdot = MatrixXd::Zero(nx, num_vars);
+    dxdot->middleCols(x_index, nx) = dz.leftCols(nx);
+    dxdot->middleCols(u_index, nu) = dz.middleCols(nx, nu);
+    dxdot->middleCols(l_index, nl) = dz.rightCols(nl);
+  };
+
+  VectorXd xdot0, xdot1;
+  MatrixXd dxdot0, dxdot1;
+  knotDynamics(x0_index, u0_index, l0_index, &xdot0, &dxdot0);
+  knotDynamics(x1_index, u1_index, l1_index, &xdot1, &dxdot1);
+
+  // Cubic interpolation to get xcol and xdotcol, and their gradients
+  const VectorXd xcol = 0.5 * (x0 + x1) + h / 8 * (xdot0 - xdot1);
+  const VectorXd xdotcol = -1.5 * (x0 - x1) / h - .25 * (xdot0 + xdot1);
+  const VectorXd ucol = 0.5 * (u0 + u1);
+
+  MatrixXd dxcol = h / 8 * (dxdot0 - dxdot1);
+  dxcol.col(h_index) += (xdot0 - xdot1) / 8;
+  dxcol.middleCols(x0_index, nx).diagonal().array() += 0.5;
+  dxcol.middleCols(x1_index, nx).diagonal().array() += 0.5;
+
+  MatrixXd dxdotcol = -.25 * (dxdot0 + dxdot1);
+  dxdotcol.col(h_index) += 1.5 * (x0 - x1) / (h * h);
+  dxdotcol.middleCols(x0_index, nx).diagonal().array() -= 1.5 / h;
+  dxdotcol.middleCols(x1_index, nx).diagonal().array() += 1.5 / h;
+
+  // Collocation point dynamics, seeded in (xcol, ucol, lc, vc)
+  VectorXd zc(nx + nu + 2*nl);
+  zc << xcol, ucol, x_val.segment(lc_index, nl), x_val.segment(vc_index, nl);
+  const AutoDiffVecXd zc_autodiff = math::initializeAutoDiff(zc);
+  constraints_->updateData(zc_autodiff.head(nx), zc_autodiff.segment(nx, nu), zc_autodiff.segment(nx + nu, nl),
+                           kEvalJ | kEvalDynamics);
+  AutoDiffVecXd g = constraints_->getXDot();
+  g.head(num_positions_) += constraints_->getJ().transpose()*zc_autodiff.tail(nl);
+  const MatrixXd dg_local = math::autoDiffToGradientMatrix(g, zc.size());
+
+  MatrixXd dg = dg_local.leftCols(nx) * dxcol;
+  dg.middleCols(u0_index, nu) += 0.5 * dg_local.middleCols(nx, nu);
+  dg.middleCols(u1_index, nu) += 0.5 * dg_local.middleCols(nx, nu);
+  dg.middleCols(lc_index, nl) += dg_local.middleCols(nx + nu, nl);
+  dg.middleCols(vc_index, nl) += dg_local.rightCols(nl);
+
+  const VectorXd y_val = xdotcol - math::autoDiffToValueMatrix(g);
+  MatrixXd dy = dxdotcol - dg;
+
+  // chain rule with the incoming derivatives
+  const MatrixXd dx_in = math::autoDiffToGradientMatrix(x);
+  if (!(dx_in.rows() == dx_in.cols() && dx_in.isIdentity(0))) {
+    dy = dy * dx_in;
+  }
+  math::initializeAutoDiffGivenGradientMatrix(y_val, dy, y);
+}
+
+template <typename T>
+DirconInverseDynamicConstraint<T>::DirconInverseDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints) :
+  DirconInverseDynamicConstraint(tree, constraints, tree.get_num_positions(), tree.get_num_velocities(), tree.get_num_actuators(),
+                                 constraints.countConstraints()) {}
+
+template <typename T>
+DirconInverseDynamicConstraint<T>::DirconInverseDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
+                                                 int num_positions, int num_velocities, int num_inputs, int num_kinematic_constraints)
+    : DirconAbstractConstraint<T>(num_positions + 2*num_velocities,
+                 1 + 2*(num_positions + num_velocities) + 2*num_inputs + 3*num_velocities + 2*num_kinematic_constraints,
+                 Eigen::VectorXd::Zero(num_positions + 2*num_velocities), Eigen::VectorXd::Zero(num_positions + 2*num_velocities)),
+      num_states_{num_positions+num_velocities}, num_inputs_{num_inputs}, num_kinematic_constraints_{num_kinematic_constraints},
+      num_positions_{num_positions}, num_velocities_{num_velocities} {
+  // the knot derivatives are [v; vdot], which requires qdot = v
+  DRAKE_DEMAND(constraints.isQDotIdentity());
+  tree_ = &tree;
+  constraints_ = &constraints;
+}
+
+// The format of the input to the eval() function is the tuple
+// { timestep, state 0, state 1, input 0, input 1, vdot 0, vdot 1,
+//   collocation force, collocation position slack, collocation vdot }
+template <typename T>
+void DirconInverseDynamicConstraint<T>::EvaluateConstraint(
+    const Eigen::Ref<const VectorX<T>>& x, VectorX<T>& y) const {
+  DIRCON_TRACE_SCOPE("DirconInverseDynamicConstraint::EvaluateConstraint");
+  DRAKE_ASSERT(x.size() == 1 + (2 * num_states_) + (2 * num_inputs_) + 3*num_velocities_ + 2*num_kinematic_constraints_);
+
+  const int nv = num_velocities_;
+  const int nl = num_kinematic_constraints_;
+  const int vdot_index = 1 + 2 * (num_states_ + num_inputs_);
+
+  const auto h = x(0);
+  const auto x0 = x.segment(1, num_states_);
+  const auto x1 = x.segment(1 + num_states_, num_states_);
+  const auto u0 = x.segment(1 + (2 * num_states_), num_inputs_);
+  const auto u1 = x.segment(1 + (2 * num_states_) + num_inputs_, num_inputs_);
+  const auto vdot0 = x.segment(vdot_index, nv);
+  const auto vdot1 = x.segment(vdot_index + nv, nv);
+  const auto lc = x.segment(vdot_index + 2*nv, nl);
+  const auto vc = x.segment(vdot_index + 2*nv + nl, nl);
+  const auto vdotc = x.segment(vdot_index + 2*nv + 2*nl, nv);
+
+  // Knot derivatives directly from the variables (qdot = v, checked at
+  // construction)
+  VectorX<T> xdot0(num_states_), xdot1(num_states_);
+  xdot0 << x0.tail(nv), vdot0;
+  xdot1 << x1.tail(nv), vdot1;
+
+  // Cubic interpolation to get xcol and xdotcol.
+  const VectorX<T> xcol = 0.5 * (x0 + x1) + h / 8 * (xdot0 - xdot1);
+  const VectorX<T> xdotcol = -1.5 * (x0 - x1) / h - .25 * (xdot0 + xdot1);
+
+  constraints_->updateInverseDynamics(xcol, vdotc, 0.5 * (u0 + u1), lc, kEvalJ | kEvalDynamics);
+  VectorX<T> g = constraints_->getXDot();
+  g.head(num_positions_) += constraints_->getJ().transpose()*vc;
+
+  y = VectorX<T>(num_states_ + nv);
+  y << xdotcol - g, constraints_->getResidual();
+}
+
 template <typename T>
 Binding<Constraint> AddDirconConstraint(
     std::shared_ptr<DirconDynamicConstraint<T>> constraint,
@@ -172,40 +450,48 @@ Binding<Constraint> AddDirconConstraint(
 template <typename T>
 DirconKinematicConstraint<T>::DirconKinematicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
                             DirconKinConstraintType type) :
-  DirconKinematicConstraint(tree, constraints, std::vector<bool>(constraints.countConstraints(), false), type,
+  DirconKinematicConstraint(tree, constraints, std::vector<bool>(constraints.countConstraints(), false), type, false,
                             tree.get_num_positions(), tree.get_num_velocities(), tree.get_num_actuators(), constraints.countConstraints()) {}
 
 template <typename T>
 DirconKinematicConstraint<T>::DirconKinematicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
-                            std::vector<bool> is_constraint_relative, DirconKinConstraintType type) :
-  DirconKinematicConstraint(tree, constraints, is_constraint_relative, type,
+                            std::vector<bool> is_constraint_relative, DirconKinConstraintType type, bool inverse_dynamics) :
+  DirconKinematicConstraint(tree, constraints, is_constraint_relative, type, inverse_dynamics,
                             tree.get_num_positions(), tree.get_num_velocities(), tree.get_num_actuators(), constraints.countConstraints()) {}
 
 template <typename T>
 DirconKinematicConstraint<T>::DirconKinematicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
-                                                     std::vector<bool> is_constraint_relative, DirconKinConstraintType type, int num_positions,
-                                                    int num_velocities, int num_inputs, int num_kinematic_constraints)
-    : DirconAbstractConstraint<T>(type*num_kinematic_constraints, num_positions + num_velocities + num_inputs + num_kinematic_constraints + std::count(is_constraint_relative.begin(),is_constraint_relative.end(),true),
-                 Eigen::VectorXd::Zero(type*num_kinematic_constraints), Eigen::VectorXd::Zero(type*num_kinematic_constraints)),
+                                                     std::vector<bool> is_constraint_relative, DirconKinConstraintType type, bool inverse_dynamics,
+                                                     int num_positions, int num_velocities, int num_inputs, int num_kinematic_constraints)
+    : DirconAbstractConstraint<T>(type*num_kinematic_constraints + (inverse_dynamics ? num_velocities : 0),
+                 num_positions + num_velocities + num_inputs + num_kinematic_constraints + std::count(is_constraint_relative.begin(),is_constraint_relative.end(),true) +
+                 (inverse_dynamics ? num_velocities : 0),
+                 Eigen::VectorXd::Zero(type*num_kinematic_constraints + (inverse_dynamics ? num_velocities : 0)),
+                 Eigen::VectorXd::Zero(type*num_kinematic_constraints + (inverse_dynamics ? num_velocities : 0))),
       num_states_{num_positions+num_velocities}, num_inputs_{num_inputs}, num_kinematic_constraints_{num_kinematic_constraints},
-      num_positions_{num_positions}, num_velocities_{num_velocities}, type_{type}, is_constraint_relative_{is_constraint_relative},
+      num_positions_{num_positions}, num_velocities_{num_velocities}, type_{type}, inverse_dynamics_{inverse_dynamics},
+      is_constraint_relative_{is_constraint_relative},
       n_relative_{(int) std::count(is_constraint_relative.begin(),is_constraint_relative.end(),true)} {
   tree_ = &tree;
   constraints_ = &constraints;
-  relative_map_ = MatrixXd::Zero(num_kinematic_constraints_,n_relative_);
-  int j = 0;
   for (int i=0; i < num_kinematic_constraints_; i++) {
     if(is_constraint_relative_[i]) {
-      relative_map_(i,j) = 1;
-      j++;
+      relative_index_.push_back(i);
     }
   }
 }
 
+template <typename T>
+size_t DirconKinematicConstraint<T>::getMemoryUsage() const {
+  return relative_index_.capacity()*sizeof(int);
+}
+
 template <typename T>
 void DirconKinematicConstraint<T>::EvaluateConstraint(
     const Eigen::Ref<const VectorX<T>>& x, VectorX<T>& y) const {
-  DRAKE_ASSERT(x.size() == num_states_ + num_inputs_ + num_kinematic_constraints_ + n_relative_);
+  DIRCON_TRACE_SCOPE("DirconKinematicConstraint::EvaluateConstraint");
+  DRAKE_ASSERT(x.size() == num_states_ + num_inputs_ + num_kinematic_constraints_ + n_relative_ +
+               (inverse_dynamics_ ? num_velocities_ : 0));
 
   // Extract our input variables:
   // h - current time (knot) value
@@ -215,21 +501,38 @@ void DirconKinematicConstraint<T>::EvaluateConstraint(
   const auto input = x.segment(num_states_, num_inputs_);
   const auto force = x.segment(num_states_ + num_inputs_, num_kinematic_constraints_);
   const auto offset = x.segment(num_states_ + num_inputs_ + num_kinematic_constraints_, n_relative_);
-  constraints_->updateData(state, input, force);
+  // c is only needed with kAll, and cdot with kAll or kAccelAndVel
+  int flags = kEvalJdotv | kEvalDynamics;
+  if (type_ == kAll)
+    flags |= kEvalC;
+  if (type_ != kAccelOnly)
+    flags |= kEvalCDot;
+  if (inverse_dynamics_) {
+    const auto vdot = x.tail(num_velocities_);
+    constraints_->updateInverseDynamics(state, vdot, input, force, flags);
+  } else {
+    constraints_->updateData(state, input, force, flags);
+  }
+  const int n_residual = inverse_dynamics_ ? num_velocities_ : 0;
+  y = VectorX<T>(type_*num_kinematic_constraints_ + n_residual);
   switch(type_) {
     case kAll:
-      y = VectorX<T>(3*num_kinematic_constraints_);
-      y << constraints_->getC() + relative_map_*offset, constraints_->getCDot(), constraints_->getCDDot();
+      y.head(3*num_kinematic_constraints_) << constraints_->getC(), constraints_->getCDot(),
+                                              constraints_->getCDDot();
+      for (int j = 0; j < n_relative_; j++) {
+        y(relative_index_[j]) += offset(j);
+      }
       break;
     case kAccelAndVel:
-      y = VectorX<T>(2*num_kinematic_constraints_);
-      y << constraints_->getCDot(), constraints_->getCDDot();
+      y.head(2*num_kinematic_constraints_) << constraints_->getCDot(), constraints_->getCDDot();
       break;
     case kAccelOnly:
-      y = VectorX<T>(1*num_kinematic_constraints_);
-      y << constraints_->getCDDot();
+      y.head(1*num_kinematic_constraints_) << constraints_->getCDDot();
       break;
   }
+  if (inverse_dynamics_) {
+    y.tail(n_residual) = constraints_->getResidual();
+  }
 }
 
 template <typename T>
@@ -253,6 +556,7 @@ DirconImpactConstraint<T>::DirconImpactConstraint(const RigidBodyTree<double>& t
 template <typename T>
 void DirconImpactConstraint<T>::EvaluateConstraint(
     const Eigen::Ref<const VectorX<T>>& x, VectorX<T>& y) const {
+  DIRCON_TRACE_SCOPE("DirconImpactConstraint::EvaluateConstraint");
   DRAKE_ASSERT(x.size() == 2 * num_velocities_ + num_positions_ + num_kinematic_constraints_);
 
   // Extract our input variables:
@@ -269,19 +573,46 @@ void DirconImpactConstraint<T>::EvaluateConstraint(
   const auto u = VectorXd::Zero(tree_->get_num_actuators()).template cast<T>();
 
   //Passing in a dummmy value for u. Impulse value also does not matter, since
-  //we only actually want J.
-  //TODO(mposa): Streamline calculations here by either caching or only doing
-  //a partial update of the constraints
-  constraints_->updateData(x0, u, impulse);
+  //we only actually want J (and M, which is always updated).
+  constraints_->updateData(x0, u, impulse, kEvalJ);
 
-  const MatrixX<T> M = tree_->massMatrix(*constraints_->getCache());
+  const auto& M = constraints_->getM();
 
   y = M*(v1 - v0) - constraints_->getJ().transpose()*impulse;
 }
 
+DirconCountingConstraint::DirconCountingConstraint(std::shared_ptr<Constraint> constraint,
+                                                   std::shared_ptr<DirconEvaluationStatistics> statistics)
+  : Constraint(constraint->num_constraints(), constraint->num_vars(), constraint->lower_bound(),
+               constraint->upper_bound(), constraint->get_description()),
+    constraint_(constraint), statistics_(statistics) {
+}
+
+void DirconCountingConstraint::DoEval(const Eigen::Ref<const Eigen::VectorXd>& x,
+                                      Eigen::VectorXd& y) const {
+  auto start = std::chrono::steady_clock::now();
+  constraint_->Eval(x, y);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  statistics_->value_evaluations++;
+  statistics_->value_time += elapsed.count();
+}
+
+void DirconCountingConstraint::DoEval(const Eigen::Ref<const AutoDiffVecXd>& x,
+                                      AutoDiffVecXd& y) const {
+  auto start = std::chrono::steady_clock::now();
+  constraint_->Eval(x, y);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  statistics_->gradient_evaluations++;
+  statistics_->gradient_time += elapsed.count();
+}
+
 // Explicitly instantiates on the most common scalar types.
+template class DirconAbstractConstraint<double>;
+template class DirconAbstractConstraint<AutoDiffXd>;
 template class DirconDynamicConstraint<double>;
 template class DirconDynamicConstraint<AutoDiffXd>;
+template class DirconInverseDynamicConstraint<double>;
+template class DirconInverseDynamicConstraint<AutoDiffXd>;
 template class DirconKinematicConstraint<double>;
 template class DirconKinematicConstraint<AutoDiffXd>;
 template class DirconImpactConstraint<double>;
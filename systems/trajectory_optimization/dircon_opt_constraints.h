@@ -1,8 +1,10 @@
 #pragma once
 
 #include <memory.h>
+#include <string>
 #include "dircon_kinematic_data.h"
 #include "dircon_kinematic_data_set.h"
+#include "dircon_solve_control.h"
 #include "drake/common/drake_copyable.h"
 #include "drake/solvers/constraint.h"
 #include "drake/common/symbolic.h"
@@ -12,6 +14,12 @@ namespace drake {
 namespace systems {
 namespace trajectory_optimization {
 
+/// Finite differencing schemes for DirconAbstractConstraint<double>
+///   kForwardDifference: (y(x + dx*e_i) - y(x))/dx
+///   kCentralDifference: (y(x + dx/2*e_i) - y(x - dx/2*e_i))/dx
+///   kScaledForwardDifference: forward, with dx_i = dx*max(1,|x_i|)
+enum DirconFiniteDifferenceType { kForwardDifference, kCentralDifference, kScaledForwardDifference };
+
 /// Helper class for all dircon constraints
 /// manages evaluation of functions and numerical gradients
 template <typename T>
@@ -31,6 +39,43 @@ class DirconAbstractConstraint : public solvers::Constraint {
   virtual void EvaluateConstraint(const Eigen::Ref<const VectorX<T>>& x,
               VectorX<T>& y) const = 0;
 
+  /// Approximates the Hessian of lambda^T y(x), for use by NLP solvers that
+  /// take a Lagrangian Hessian, by central differences of the exact AutoDiff
+  /// gradients (num_vars evaluations, O(dx^2) error with dx = 1e-6).
+  /// Only available with T = AutoDiffXd; with T = double, which has no exact
+  /// gradients to difference, it throws std::logic_error.
+  /// @param x the point at which to evaluate
+  /// @param lambda multipliers, one per constraint row
+  /// @param hessian the (symmetric) num_vars x num_vars result
+  void EvalLagrangianHessian(const Eigen::Ref<const Eigen::VectorXd>& x,
+                             const Eigen::Ref<const Eigen::VectorXd>& lambda,
+                             Eigen::MatrixXd* hessian) const;
+
+  /// Set the finite differencing scheme used for gradients when T = double.
+  /// Has no effect for T = AutoDiffXd.
+  /// @param type the differencing scheme
+  /// @param dx the step size. If not positive, a default for the scheme is used
+  ///   (1e-8 forward, 1e-6 central, sqrt(machine eps) scaled forward)
+  void setFiniteDifference(DirconFiniteDifferenceType type, double dx = 0);
+
+  DirconFiniteDifferenceType getFiniteDifferenceType() const { return difference_type_; }
+  double getFiniteDifferenceStep() const { return dx_; }
+
+  /// Approximate heap memory held by the constraint beyond its bounds, in
+  /// bytes (see dircon::programMemoryUsage)
+  virtual size_t getMemoryUsage() const { return 0; }
+
+  /// Reports each evaluation to @p control (see HybridDircon::SolveAsync).
+  /// May be null, for no reporting.
+  void setSolveControl(std::shared_ptr<DirconSolveControl> control) { solve_control_ = control; }
+
+ private:
+  // progress report after each DoEval
+  void recordEvaluation(const Eigen::VectorXd& y) const;
+
+  DirconFiniteDifferenceType difference_type_{kForwardDifference};
+  double dx_{1e-8};
+  std::shared_ptr<DirconSolveControl> solve_control_;
 };
 
 enum DirconKinConstraintType { kAll = 3, kAccelAndVel = 2, kAccelOnly = 1 };
@@ -58,10 +103,59 @@ class DirconDynamicConstraint : public DirconAbstractConstraint<T> {
   void EvaluateConstraint(const Eigen::Ref<const VectorX<T>>& x,
               VectorX<T>& y) const override;
 
+  size_t getMemoryUsage() const override;
+
  private:
   DirconDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
     int num_positions, int num_velocities, int num_inputs, int num_kinematic_constraints);
 
+  // xdot at knot 0 or 1, memoized on the knot's (state, input, force).
+  // h, lc and vc only enter the collocation point, so finite differencing
+  // them (or the other knot's variables) reuses the knot dynamics.
+  const VectorX<T>& knotXDot(int knot, const Eigen::Ref<const VectorX<T>>& state,
+    const Eigen::Ref<const VectorX<T>>& input, const Eigen::Ref<const VectorX<T>>& force) const;
+
+  const RigidBodyTree<double>* tree_;
+  DirconKinematicDataSet<T>* constraints_;
+  mutable VectorX<T> knot_vars_[2];
+  mutable VectorX<T> knot_xdot_[2];
+
+  const int num_positions_{0};
+  const int num_velocities_{0};
+  const int num_states_{0};
+  const int num_inputs_{0};
+  const int num_kinematic_constraints_{0};
+};
+
+/// Inverse-dynamics version of DirconDynamicConstraint. The accelerations at
+/// the knots and the collocation point are decision variables, so the knot
+/// derivatives are simply xdot = [v; vdot] and no forward dynamics (or mass
+/// matrix factorization) is evaluated. The dynamics enter as the residual
+///   M*vdot + C - B*u - J^T*lambda = 0
+/// at the collocation point here, and at the knots through
+/// DirconKinematicConstraint with inverse_dynamics set.
+/// The constraint is the collocation defect followed by the residual.
+/// Since qdot is taken to be v, the tree must have qdot = v (no quaternion
+/// floating base); the constructor demands this.
+template <typename T>
+class DirconInverseDynamicConstraint : public DirconAbstractConstraint<T> {
+ public:
+  DirconInverseDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints);
+
+  ~DirconInverseDynamicConstraint() override = default;
+
+  int num_states() const { return num_states_; }
+  int num_inputs() const { return num_inputs_; }
+  int num_kinematic_constraints() const { return num_kinematic_constraints_; }
+
+ public:
+  void EvaluateConstraint(const Eigen::Ref<const VectorX<T>>& x,
+              VectorX<T>& y) const override;
+
+ private:
+  DirconInverseDynamicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraints,
+    int num_positions, int num_velocities, int num_inputs, int num_kinematic_constraints);
+
   const RigidBodyTree<double>* tree_;
   DirconKinematicDataSet<T>* constraints_;
 
@@ -100,18 +194,25 @@ class DirconKinematicConstraint : public DirconAbstractConstraint<T> {
   /// @param DirconKinematicDataSet the set of kinematic constraints to be enforced
   /// @param is_constraint_relative vector of booleans specifying whether constraints are relative
   /// @param type the constraint type (all, accel and vel, accel only). Defaults to all
+  /// @param inverse_dynamics if true, the knot acceleration vdot is appended to
+  ///   the variables, cddot is computed from it, and the dynamics residual
+  ///   (num_velocities rows) is appended to the constraint
   DirconKinematicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraint_data,
-                            std::vector<bool> is_constraint_relative, DirconKinConstraintType type = DirconKinConstraintType::kAll);
+                            std::vector<bool> is_constraint_relative, DirconKinConstraintType type = DirconKinConstraintType::kAll,
+                            bool inverse_dynamics = false);
 
   ~DirconKinematicConstraint() override = default;
 
   void EvaluateConstraint(const Eigen::Ref<const VectorX<T>>& x,
               VectorX<T>& y) const override;
 
+  size_t getMemoryUsage() const override;
+
  protected:
  private:
   DirconKinematicConstraint(const RigidBodyTree<double>& tree, DirconKinematicDataSet<T>& constraint_data, std::vector<bool> is_constraint_relative,
-                            DirconKinConstraintType type, int num_positions, int num_velocities, int num_inputs, int num_kinematic_constraints);
+                            DirconKinConstraintType type, bool inverse_dynamics, int num_positions, int num_velocities, int num_inputs,
+                            int num_kinematic_constraints);
 
 
   const RigidBodyTree<double>* tree_;
@@ -123,9 +224,11 @@ class DirconKinematicConstraint : public DirconAbstractConstraint<T> {
   const int num_inputs_{0};
   const int num_kinematic_constraints_{0};
   const DirconKinConstraintType type_{kAll};
+  const bool inverse_dynamics_{false};
   const std::vector<bool> is_constraint_relative_;
   const int n_relative_;
-  Eigen::MatrixXd relative_map_;
+  // constraint row of each relative offset
+  std::vector<int> relative_index_;
 };
 
 /// Helper method to add a DirconDynamicConstraint to the @p prog,
@@ -180,6 +283,50 @@ class DirconImpactConstraint : public DirconAbstractConstraint<T> {
   const int num_states_{0};
   const int num_kinematic_constraints_{0};
 };
+
+/// Evaluation counts and cumulative wall-clock time (in seconds) of one
+/// binding. Value evaluations are calls with double arguments, and gradient
+/// evaluations calls with AutoDiffXd arguments (as made by SNOPT for the
+/// constraint Jacobian).
+struct DirconEvaluationStatistics {
+  /// "dynamic", "inverse_dynamic", "kinematic", "impact" or "friction"
+  std::string type;
+  int mode{0};
+  /// the knot within the mode (for dynamic constraints, the first knot of
+  /// the interval, and for impacts, the first knot of the post-impact mode)
+  int knot{0};
+  long value_evaluations{0};
+  long gradient_evaluations{0};
+  double value_time{0};
+  double gradient_time{0};
+};
+
+/// Forwards each evaluation to a shared constraint, recording it in the
+/// statistics of this binding. Lets one constraint object be shared by all
+/// knots of a mode while still counting per knot.
+class DirconCountingConstraint : public solvers::Constraint {
+ public:
+  DirconCountingConstraint(std::shared_ptr<solvers::Constraint> constraint,
+                           std::shared_ptr<DirconEvaluationStatistics> statistics);
+
+  ~DirconCountingConstraint() override = default;
+
+  /// The wrapped constraint
+  const std::shared_ptr<solvers::Constraint>& constraint() const { return constraint_; }
+
+  const DirconEvaluationStatistics& statistics() const { return *statistics_; }
+
+ protected:
+  void DoEval(const Eigen::Ref<const Eigen::VectorXd>& x,
+              Eigen::VectorXd& y) const override;
+
+  void DoEval(const Eigen::Ref<const AutoDiffVecXd>& x,
+              AutoDiffVecXd& y) const override;
+
+ private:
+  std::shared_ptr<solvers::Constraint> constraint_;
+  std::shared_ptr<DirconEvaluationStatistics> statistics_;
+};
 }
 }
 }
\ No newline at end of file
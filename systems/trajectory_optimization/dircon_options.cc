@@ -15,6 +15,11 @@ DirconOptions::DirconOptions(int n_constraints) {
   start_constraint_type_ = DirconKinConstraintType::kAll;
   end_constraint_type_ = DirconKinConstraintType::kAll;
   force_cost_ = 1.0e-4;
+  difference_type_ = DirconFiniteDifferenceType::kForwardDifference;
+  difference_step_ = 0;
+  knot_interleaved_forces_ = false;
+  inverse_dynamics_ = false;
+  evaluation_statistics_ = false;
 }
 
 void DirconOptions::setAllConstraintsRelative(bool relative) {
@@ -39,6 +44,23 @@ void DirconOptions::setForceCost(double force_cost) {
   force_cost_ = force_cost;
 }
 
+void DirconOptions::setFiniteDifference(DirconFiniteDifferenceType type, double dx) {
+  difference_type_ = type;
+  difference_step_ = dx;
+}
+
+void DirconOptions::setKnotInterleavedForces(bool interleaved) {
+  knot_interleaved_forces_ = interleaved;
+}
+
+void DirconOptions::setInverseDynamics(bool inverse) {
+  inverse_dynamics_ = inverse;
+}
+
+void DirconOptions::setEvaluationStatistics(bool statistics) {
+  evaluation_statistics_ = statistics;
+}
+
 int DirconOptions::getNumConstraints() {
   return n_constraints_;
 }
@@ -63,6 +85,26 @@ double DirconOptions::getForceCost() {
   return force_cost_;
 }
 
+DirconFiniteDifferenceType DirconOptions::getFiniteDifferenceType() {
+  return difference_type_;
+}
+
+double DirconOptions::getFiniteDifferenceStep() {
+  return difference_step_;
+}
+
+bool DirconOptions::getKnotInterleavedForces() {
+  return knot_interleaved_forces_;
+}
+
+bool DirconOptions::getInverseDynamics() {
+  return inverse_dynamics_;
+}
+
+bool DirconOptions::getEvaluationStatistics() {
+  return evaluation_statistics_;
+}
+
 int DirconOptions::getNumRelative() {
   return (int) std::count(is_constraints_relative_.begin(),is_constraints_relative_.end(),true);
 }
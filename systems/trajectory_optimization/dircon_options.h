@@ -14,6 +14,11 @@ class DirconOptions {
     DirconKinConstraintType start_constraint_type_;
     DirconKinConstraintType end_constraint_type_;
     double force_cost_;
+    DirconFiniteDifferenceType difference_type_;
+    double difference_step_;
+    bool knot_interleaved_forces_;
+    bool inverse_dynamics_;
+    bool evaluation_statistics_;
 
   public:
     DirconOptions(int n_constraints);
@@ -23,6 +28,21 @@ class DirconOptions {
     void setStartType(DirconKinConstraintType type);
     void setEndType(DirconKinConstraintType type);
     void setForceCost(double force_cost);
+    void setFiniteDifference(DirconFiniteDifferenceType type, double dx = 0);
+    /// Allocate the force and slack variables knot by knot
+    /// (lambda_k, lambda_c_k, v_c_k) rather than in type blocks, which keeps
+    /// each interval's Jacobian columns adjacent. The variables are then
+    /// named by mode and knot, e.g. lambda[mode][knot]
+    void setKnotInterleavedForces(bool interleaved);
+    /// Use the inverse-dynamics formulation for this mode: accelerations are
+    /// decision variables at the knots and collocation points, and the
+    /// dynamics are imposed as the residual M*vdot + C - B*u - J^T*lambda = 0
+    /// rather than by solving for vdot. Requires qdot = v for the tree
+    void setInverseDynamics(bool inverse);
+    /// Count the evaluations of each of this mode's nonlinear bindings and
+    /// time them (see HybridDircon::GetEvaluationStatistics). The bindings
+    /// then hold a DirconCountingConstraint around the DIRCON constraint
+    void setEvaluationStatistics(bool statistics);
 
     int getNumConstraints();
     bool getSingleConstraintRelative(int index);
@@ -30,6 +50,11 @@ class DirconOptions {
     DirconKinConstraintType getStartType();
     DirconKinConstraintType getEndType();
     double getForceCost();
+    DirconFiniteDifferenceType getFiniteDifferenceType();
+    double getFiniteDifferenceStep();
+    bool getKnotInterleavedForces();
+    bool getInverseDynamics();
+    bool getEvaluationStatistics();
     int getNumRelative();
 };
 
@@ -1,4 +1,5 @@
 #include "dircon_position_data.h"
+#include "dircon_trace.h"
 
 namespace drake{
 using Eigen::Vector2d;
@@ -19,21 +20,33 @@ DirconPositionData<T>::~DirconPositionData() {
 }
 
 template <typename T>
-void DirconPositionData<T>::updateConstraint(KinematicsCache<T>& cache) {
-  auto pts = this->tree_->transformPoints(cache,pt_,bodyIdx_,0);
-
+void DirconPositionData<T>::updateConstraint(KinematicsCache<T>& cache, int flags) {
+  DIRCON_TRACE_SCOPE("DirconPositionData::updateConstraint");
   //TODO: implement some caching here, check cache.getV and cache.getQ before recomputing
   auto v = cache.getV();
   if (isXZ_) {
-    this->c_ = TXZ_*pts;
-    this->J_ = TXZ_*this->tree_->transformPointsJacobian(cache, pt_,bodyIdx_,0, true);
-    this->cdot_ = this->J_*v;
-    this->Jdotv_ = TXZ_*this->tree_->transformPointsJacobianDotTimesV(cache, pt_,bodyIdx_,0);
+    if (flags & kEvalC) {
+      this->c_ = TXZ_*this->tree_->transformPoints(cache,pt_,bodyIdx_,0);
+    }
+    if (flags & (kEvalJ | kEvalCDot)) {
+      this->J_ = TXZ_*this->tree_->transformPointsJacobian(cache, pt_,bodyIdx_,0, true);
+    }
+    if (flags & kEvalJdotv) {
+      this->Jdotv_ = TXZ_*this->tree_->transformPointsJacobianDotTimesV(cache, pt_,bodyIdx_,0);
+    }
   } else {
-    this->c_ = pts;
-    this->J_ = this->tree_->transformPointsJacobian(cache, pt_,bodyIdx_,0, true);
+    if (flags & kEvalC) {
+      this->c_ = this->tree_->transformPoints(cache,pt_,bodyIdx_,0);
+    }
+    if (flags & (kEvalJ | kEvalCDot)) {
+      this->J_ = this->tree_->transformPointsJacobian(cache, pt_,bodyIdx_,0, true);
+    }
+    if (flags & kEvalJdotv) {
+      this->Jdotv_ = this->tree_->transformPointsJacobianDotTimesV(cache, pt_,bodyIdx_,0);
+    }
+  }
+  if (flags & kEvalCDot) {
     this->cdot_ = this->J_*v;
-    this->Jdotv_ = this->tree_->transformPointsJacobianDotTimesV(cache, pt_,bodyIdx_,0);
   }
 }
 
@@ -18,7 +18,7 @@ class DirconPositionData : public DirconKinematicData<T> {
     ~DirconPositionData();
 
     //The workhorse function, updates and caches everything needed by the outside world
-    void updateConstraint(KinematicsCache<T>& cache);
+    void updateConstraint(KinematicsCache<T>& cache, int flags = kEvalAll);
 
     void addFixedNormalFrictionConstraints(Vector3d normal, double mu);
 
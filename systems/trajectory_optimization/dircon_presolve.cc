@@ -0,0 +1,476 @@
+#include "dircon_presolve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+#include "drake/math/autodiff.h"
+#include "drake/math/autodiff_gradient.h"
+
+namespace drake{
+namespace systems {
+namespace trajectory_optimization{
+
+using solvers::Binding;
+using solvers::Constraint;
+using solvers::Cost;
+using solvers::MathematicalProgram;
+using solvers::VectorXDecisionVariable;
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+namespace {
+
+// Evaluates an evaluator of the original program at x = P*z + c
+template <typename Evaluator>
+void evalMapped(const Evaluator& evaluator, const MatrixXd& P, const VectorXd& c,
+                const Eigen::Ref<const VectorXd>& z, VectorXd& y) {
+  evaluator.Eval(P*z + c, y);
+}
+
+template <typename Evaluator>
+void evalMapped(const Evaluator& evaluator, const MatrixXd& P, const VectorXd& c,
+                const Eigen::Ref<const AutoDiffVecXd>& z, AutoDiffVecXd& y) {
+  const VectorXd z_val = math::autoDiffToValueMatrix(z);
+  const MatrixXd dz = math::autoDiffToGradientMatrix(z);
+  AutoDiffVecXd x;
+  math::initializeAutoDiffGivenGradientMatrix(VectorXd(P*z_val + c), MatrixXd(P*dz), x);
+  evaluator.Eval(x, y);
+}
+
+// row_scale multiplies the constraint values and bounds
+class PresolvedConstraint : public Constraint {
+ public:
+  PresolvedConstraint(std::shared_ptr<Constraint> constraint, const MatrixXd& P, const VectorXd& c,
+                      const VectorXd& row_scale)
+      : Constraint(constraint->num_constraints(), P.cols(), constraint->lower_bound().cwiseProduct(row_scale),
+                   constraint->upper_bound().cwiseProduct(row_scale), constraint->get_description()),
+        constraint_(constraint), P_(P), c_(c), row_scale_(row_scale) {}
+
+ protected:
+  void DoEval(const Eigen::Ref<const VectorXd>& z, VectorXd& y) const override {
+    evalMapped(*constraint_, P_, c_, z, y);
+    y = y.cwiseProduct(row_scale_);
+  }
+  void DoEval(const Eigen::Ref<const AutoDiffVecXd>& z, AutoDiffVecXd& y) const override {
+    evalMapped(*constraint_, P_, c_, z, y);
+    for (int i = 0; i < y.size(); i++) {
+      y(i) *= row_scale_(i);
+    }
+  }
+
+ private:
+  std::shared_ptr<Constraint> constraint_;
+  const MatrixXd P_;
+  const VectorXd c_;
+  const VectorXd row_scale_;
+};
+
+class PresolvedCost : public Cost {
+ public:
+  PresolvedCost(std::shared_ptr<Cost> cost, const MatrixXd& P, const VectorXd& c)
+      : Cost(P.cols(), cost->get_description()), cost_(cost), P_(P), c_(c) {}
+
+ protected:
+  void DoEval(const Eigen::Ref<const VectorXd>& z, VectorXd& y) const override {
+    evalMapped(*cost_, P_, c_, z, y);
+  }
+  void DoEval(const Eigen::Ref<const AutoDiffVecXd>& z, AutoDiffVecXd& y) const override {
+    evalMapped(*cost_, P_, c_, z, y);
+  }
+
+ private:
+  std::shared_ptr<Cost> cost_;
+  const MatrixXd P_;
+  const VectorXd c_;
+};
+
+double clampScale(double s) {
+  return std::min(1e3, std::max(1e-3, s));
+}
+
+bool withinBounds(const VectorXd& y, const VectorXd& lb, const VectorXd& ub, double tol) {
+  return (y.array() >= lb.array() - tol).all() && (y.array() <= ub.array() + tol).all();
+}
+
+}  // namespace
+
+DirconPresolve::DirconPresolve(MathematicalProgram* prog, bool scaling, double tol)
+    : prog_(prog), tol_(tol), scaling_(scaling) {
+  // Only bounding box, linear, Lorentz cone and generic constraints are
+  // carried into the reduced program
+  if (!prog->rotated_lorentz_cone_constraints().empty() ||
+      !prog->linear_complementarity_constraints().empty() ||
+      !prog->positive_semidefinite_constraints().empty() ||
+      !prog->linear_matrix_inequality_constraints().empty()) {
+    throw std::runtime_error("DirconPresolve: unsupported constraint type (rotated Lorentz cone, linear "
+                             "complementarity, positive semidefinite or linear matrix inequality)");
+  }
+
+  const int n = prog->num_vars();
+  rep_.resize(n);
+  for (int i = 0; i < n; i++) {
+    rep_[i] = i;
+  }
+  scale_ = VectorXd::Ones(n);
+  offset_ = VectorXd::Zero(n);
+  lb_ = VectorXd::Constant(n, -std::numeric_limits<double>::infinity());
+  ub_ = VectorXd::Constant(n, std::numeric_limits<double>::infinity());
+
+  // Intersect all bounds, and fix variables with equal bounds
+  for (auto const& binding : prog->bounding_box_constraints()) {
+    auto indices = prog->FindDecisionVariableIndices(binding.variables());
+    for (size_t k = 0; k < indices.size(); k++) {
+      lb_(indices[k]) = std::max(lb_(indices[k]), binding.evaluator()->lower_bound()(k));
+      ub_(indices[k]) = std::min(ub_(indices[k]), binding.evaluator()->upper_bound()(k));
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (lb_(i) > ub_(i) + tol_) {
+      throw std::runtime_error("DirconPresolve: inconsistent bounds on a variable");
+    }
+    if (ub_(i) - lb_(i) <= tol_) {
+      fix(i, 0.5*(lb_(i) + ub_(i)));
+    }
+  }
+
+  // Eliminate linear equality rows with at most two free variables, until
+  // no row changes
+  auto const& equalities = prog->linear_equality_constraints();
+  row_eliminated_.resize(equalities.size());
+  for (size_t k = 0; k < equalities.size(); k++) {
+    row_eliminated_[k].resize(equalities[k].evaluator()->num_constraints(), false);
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t k = 0; k < equalities.size(); k++) {
+      auto const& A = equalities[k].evaluator()->A();
+      auto const& b = equalities[k].evaluator()->lower_bound();
+      auto indices = prog->FindDecisionVariableIndices(equalities[k].variables());
+      for (int row = 0; row < A.rows(); row++) {
+        if (!row_eliminated_[k][row] && reduceRow(A.row(row), b(row), indices)) {
+          row_eliminated_[k][row] = true;
+          num_eliminated_rows_++;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // x = P*z + c
+  for (int i = 0; i < n; i++) {
+    find(i);
+  }
+  z_index_.resize(n, -1);
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (rep_[i] == i) {
+      z_index_[i] = m++;
+    }
+  }
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int i = 0; i < n; i++) {
+    if (rep_[i] >= 0) {
+      triplets.push_back(Eigen::Triplet<double>(i, z_index_[rep_[i]], scale_(i)));
+    }
+  }
+  P_.resize(n, m);
+  P_.setFromTriplets(triplets.begin(), triplets.end());
+  c_ = offset_;
+
+  computeVariableScale();
+  P_ = P_*variable_scale_.asDiagonal();
+
+  buildReducedProgram();
+}
+
+int DirconPresolve::find(int i) {
+  const int p = rep_[i];
+  if (p == -1 || p == i) {
+    return p;
+  }
+  const int r = find(p);
+  // x_i = scale_i*(scale_p*x_r + offset_p) + offset_i
+  offset_(i) += scale_(i)*offset_(p);
+  scale_(i) = (r == -1) ? 0 : scale_(i)*scale_(p);
+  rep_[i] = r;
+  return r;
+}
+
+void DirconPresolve::fix(int i, double value) {
+  if (value < lb_(i) - 1e-6*(1 + std::abs(value)) || value > ub_(i) + 1e-6*(1 + std::abs(value))) {
+    throw std::runtime_error("DirconPresolve: a fixed variable violates its bounds");
+  }
+  rep_[i] = -1;
+  scale_(i) = 0;
+  offset_(i) = value;
+  num_fixed_++;
+}
+
+void DirconPresolve::alias(int i, int j, double scale, double offset) {
+  // x_j = scale*x_i + offset, so the bounds on x_j bound x_i
+  double lb = (lb_(j) - offset)/scale;
+  double ub = (ub_(j) - offset)/scale;
+  if (scale < 0) {
+    std::swap(lb, ub);
+  }
+  lb_(i) = std::max(lb_(i), lb);
+  ub_(i) = std::min(ub_(i), ub);
+
+  rep_[j] = i;
+  scale_(j) = scale;
+  offset_(j) = offset;
+  num_aliased_++;
+
+  if (lb_(i) > ub_(i) + tol_) {
+    throw std::runtime_error("DirconPresolve: inconsistent bounds on aliased variables");
+  }
+  if (ub_(i) - lb_(i) <= tol_) {
+    fix(i, 0.5*(lb_(i) + ub_(i)));
+  }
+}
+
+bool DirconPresolve::reduceRow(const Eigen::Ref<const Eigen::RowVectorXd>& a, double b,
+                               const std::vector<int>& indices) {
+  // a*x = b, in terms of the current representatives
+  std::map<int, double> coefficients;
+  double rhs = b;
+  for (int k = 0; k < a.size(); k++) {
+    if (a(k) == 0) {
+      continue;
+    }
+    const int r = find(indices[k]);
+    rhs -= a(k)*offset_(indices[k]);
+    if (r >= 0) {
+      coefficients[r] += a(k)*scale_(indices[k]);
+    }
+  }
+  const double threshold = tol_*std::max(1.0, a.cwiseAbs().maxCoeff());
+  for (auto it = coefficients.begin(); it != coefficients.end();) {
+    it = (std::abs(it->second) <= threshold) ? coefficients.erase(it) : std::next(it);
+  }
+
+  if (coefficients.size() == 0) {
+    if (std::abs(rhs) > 1e-6*(1 + std::abs(b))) {
+      throw std::runtime_error("DirconPresolve: inconsistent linear equality constraint");
+    }
+    return true;
+  } else if (coefficients.size() == 1) {
+    fix(coefficients.begin()->first, rhs/coefficients.begin()->second);
+    return true;
+  } else if (coefficients.size() == 2) {
+    // a_i*x_i + a_j*x_j = rhs, keeping the lower index i
+    auto it = coefficients.begin();
+    const int i = it->first;
+    const double a_i = it->second;
+    ++it;
+    const int j = it->first;
+    const double a_j = it->second;
+    alias(i, j, -a_i/a_j, rhs/a_j);
+    return true;
+  }
+  return false;
+}
+
+void DirconPresolve::computeVariableScale() {
+  variable_scale_ = VectorXd::Ones(P_.cols());
+  if (!scaling_) {
+    return;
+  }
+  const VectorXd& guess = prog_->initial_guess();
+  for (size_t i = 0; i < rep_.size(); i++) {
+    if (z_index_[i] < 0) {
+      continue;
+    }
+    double s = 0;
+    if (std::isfinite(lb_(i)) && std::isfinite(ub_(i))) {
+      s = std::max(std::abs(lb_(i)), std::abs(ub_(i)));
+    } else if (static_cast<int>(i) < guess.size() && !std::isnan(guess(i))) {
+      s = std::abs(guess(i));
+    }
+    if (s > 0) {
+      variable_scale_(z_index_[i]) = clampScale(s);
+    }
+  }
+}
+
+void DirconPresolve::bindingMap(const VectorXDecisionVariable& variables, MatrixXd* P,
+                                VectorXd* c, VectorXDecisionVariable* z) const {
+  auto indices = prog_->FindDecisionVariableIndices(variables);
+  std::vector<int> columns;
+  std::map<int, int> column_of;
+  for (int i : indices) {
+    const int r = rep_[i];
+    if (r >= 0 && column_of.find(r) == column_of.end()) {
+      column_of[r] = columns.size();
+      columns.push_back(r);
+    }
+  }
+  *P = MatrixXd::Zero(indices.size(), columns.size());
+  c->resize(indices.size());
+  for (size_t k = 0; k < indices.size(); k++) {
+    if (rep_[indices[k]] >= 0) {
+      (*P)(k, column_of[rep_[indices[k]]]) = scale_(indices[k])*variable_scale_(z_index_[rep_[indices[k]]]);
+    }
+    (*c)(k) = offset_(indices[k]);
+  }
+  z->resize(columns.size());
+  for (size_t k = 0; k < columns.size(); k++) {
+    (*z)(k) = z_(z_index_[columns[k]]);
+  }
+}
+
+void DirconPresolve::buildReducedProgram() {
+  reduced_.reset(new MathematicalProgram());
+  z_ = reduced_->NewContinuousVariables(P_.cols(), "z");
+
+  VectorXd z_lb(P_.cols());
+  VectorXd z_ub(P_.cols());
+  for (size_t i = 0; i < rep_.size(); i++) {
+    if (rep_[i] == static_cast<int>(i)) {
+      z_lb(z_index_[i]) = lb_(i)/variable_scale_(z_index_[i]);
+      z_ub(z_index_[i]) = ub_(i)/variable_scale_(z_index_[i]);
+    }
+  }
+  if (P_.cols() > 0) {
+    reduced_->AddBoundingBoxConstraint(z_lb, z_ub, z_);
+  }
+
+  MatrixXd P;
+  VectorXd c;
+  VectorXDecisionVariable z;
+
+  // Linear constraints, keeping the rows that still depend on z
+  auto addLinear = [&](const MatrixXd& A, const VectorXd& lb, const VectorXd& ub,
+                       const VectorXDecisionVariable& variables, const std::vector<bool>& skip, bool equality) {
+    bindingMap(variables, &P, &c, &z);
+    const MatrixXd A_z = A*P;
+    const VectorXd shift = A*c;
+    std::vector<int> rows;
+    for (int row = 0; row < A.rows(); row++) {
+      if (skip.size() > 0 && skip[row]) {
+        continue;
+      }
+      if (A_z.row(row).isZero(0)) {
+        if (!withinBounds(shift.segment(row, 1), lb.segment(row, 1), ub.segment(row, 1), 1e-6)) {
+          throw std::runtime_error("DirconPresolve: inconsistent linear constraint");
+        }
+        num_eliminated_rows_++;
+      } else {
+        rows.push_back(row);
+      }
+    }
+    if (rows.empty()) {
+      return;
+    }
+    MatrixXd A_kept(rows.size(), A_z.cols());
+    VectorXd lb_kept(rows.size());
+    VectorXd ub_kept(rows.size());
+    for (size_t k = 0; k < rows.size(); k++) {
+      const double row_scale = scaling_ ? clampScale(1/A_z.row(rows[k]).cwiseAbs().maxCoeff()) : 1;
+      A_kept.row(k) = row_scale*A_z.row(rows[k]);
+      lb_kept(k) = row_scale*(lb(rows[k]) - shift(rows[k]));
+      ub_kept(k) = row_scale*(ub(rows[k]) - shift(rows[k]));
+    }
+    if (equality) {
+      reduced_->AddLinearEqualityConstraint(A_kept, lb_kept, z);
+    } else {
+      reduced_->AddLinearConstraint(A_kept, lb_kept, ub_kept, z);
+    }
+  };
+
+  for (auto const& binding : prog_->linear_constraints()) {
+    auto const& e = binding.evaluator();
+    addLinear(e->A(), e->lower_bound(), e->upper_bound(), binding.variables(), {}, false);
+  }
+  auto const& equalities = prog_->linear_equality_constraints();
+  for (size_t k = 0; k < equalities.size(); k++) {
+    auto const& e = equalities[k].evaluator();
+    addLinear(e->A(), e->lower_bound(), e->upper_bound(), equalities[k].variables(), row_eliminated_[k], true);
+  }
+
+  // z at the initial guess, for the row scaling
+  VectorXd guess = prog_->initial_guess();
+  for (int i = 0; i < guess.size(); i++) {
+    if (std::isnan(guess(i))) {
+      guess(i) = 0;
+    }
+  }
+  const VectorXd z_guess = reduceGuess(guess);
+
+  // Nonlinear constraints, evaluated through x = P*z + c
+  std::vector<Binding<Constraint>> nonlinear_constraints;
+  for (auto const& binding : prog_->lorentz_cone_constraints()) {
+    nonlinear_constraints.push_back(binding);
+  }
+  for (auto const& binding : prog_->generic_constraints()) {
+    nonlinear_constraints.push_back(binding);
+  }
+  for (auto const& binding : nonlinear_constraints) {
+    bindingMap(binding.variables(), &P, &c, &z);
+    if (z.size() == 0) {
+      VectorXd y;
+      binding.evaluator()->Eval(c, y);
+      if (!withinBounds(y, binding.evaluator()->lower_bound(), binding.evaluator()->upper_bound(), 1e-6)) {
+        throw std::runtime_error("DirconPresolve: constraint violated by fixed variables: " +
+                                 binding.evaluator()->get_description());
+      }
+      continue;
+    }
+    VectorXd row_scale = VectorXd::Ones(binding.evaluator()->num_constraints());
+    if (scaling_) {
+      VectorXd z_binding(z.size());
+      for (int k = 0; k < z.size(); k++) {
+        z_binding(k) = z_guess(reduced_->FindDecisionVariableIndex(z(k)));
+      }
+      AutoDiffVecXd y;
+      evalMapped(*binding.evaluator(), P, c, math::initializeAutoDiff(z_binding), y);
+      const MatrixXd gradient = math::autoDiffToGradientMatrix(y, z.size());
+      for (int row = 0; row < gradient.rows(); row++) {
+        const double max_gradient = gradient.row(row).cwiseAbs().maxCoeff();
+        if (max_gradient > 0) {
+          row_scale(row) = clampScale(1/max_gradient);
+        }
+      }
+    }
+    reduced_->AddConstraint(std::make_shared<PresolvedConstraint>(binding.evaluator(), P, c, row_scale), z);
+  }
+
+  // Costs, dropping those that are constant
+  for (auto const& binding : prog_->GetAllCosts()) {
+    bindingMap(binding.variables(), &P, &c, &z);
+    if (z.size() > 0) {
+      reduced_->AddCost(std::make_shared<PresolvedCost>(binding.evaluator(), P, c), z);
+    }
+  }
+}
+
+solvers::SolutionResult DirconPresolve::Solve() {
+  reduced_->SetInitialGuessForAllVariables(reduceGuess(prog_->initial_guess()));
+  const solvers::SolutionResult result = reduced_->Solve();
+  const VectorXd z = reduced_->GetSolution(z_);
+  prog_->SetDecisionVariableValues(expandSolution(z));
+  return result;
+}
+
+VectorXd DirconPresolve::expandSolution(const VectorXd& z) const {
+  return P_*z + c_;
+}
+
+VectorXd DirconPresolve::reduceGuess(const VectorXd& x) const {
+  VectorXd z(P_.cols());
+  for (size_t i = 0; i < rep_.size(); i++) {
+    if (z_index_[i] >= 0) {
+      z(z_index_[i]) = x(i)/variable_scale_(z_index_[i]);
+    }
+  }
+  return z;
+}
+
+}
+}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <Eigen/Sparse>
+#include "drake/solvers/mathematical_program.h"
+#include "drake/solvers/constraint.h"
+
+namespace drake{
+namespace systems {
+namespace trajectory_optimization{
+
+/// Presolve for a built MathematicalProgram (e.g. a HybridDircon), which
+/// substitutes out variables that are fixed by bounds or determined by simple
+/// linear equalities.
+///   - A variable with equal lower and upper bounds is fixed.
+///   - A linear equality row with a single free variable fixes it.
+///   - A linear equality row a*x_i + b*x_j = d makes x_j an affine alias of x_i.
+/// This is repeated until no rows change, so chains such as
+/// x0(i) == xf(j), xf(j) == v_post(k) collapse onto one variable.
+///
+/// The result is a parameterization x = P*z + c of the original variables by
+/// the remaining free variables z, and a reduced program over z:
+///   - bounds of aliased variables are intersected onto their representative
+///   - linear constraints are rewritten in z, dropping eliminated rows
+///   - generic constraints and costs are evaluated through x = P*z + c
+/// With scaling, the free variables are also scaled, z = diag(s)*z_scaled,
+/// with s from the finite bounds or else the initial guess, and each
+/// constraint row is divided by its largest Jacobian entry (in the scaled
+/// variables) at the initial guess. This brings timesteps, states and forces
+/// to comparable magnitudes. All scale factors are clamped to [1e-3, 1e3].
+/// Bounding box, linear, linear equality, Lorentz cone and generic
+/// constraints are supported; the constructor throws if the program has
+/// constraints of any other type.
+/// The original program and its evaluators must outlive this object, and must
+/// not gain variables or constraints after construction.
+class DirconPresolve {
+  public:
+    explicit DirconPresolve(solvers::MathematicalProgram* prog, bool scaling = false, double tol = 1e-10);
+
+    /// The program over z. Solver options should be set on this program.
+    solvers::MathematicalProgram* reduced_program() { return reduced_.get(); }
+
+    /// Solves the reduced program, starting from the initial guess of the
+    /// original program, and writes the expanded solution back into the
+    /// original program so that GetSolution() and the trajectory
+    /// reconstruction of HybridDircon can be used as usual.
+    solvers::SolutionResult Solve();
+
+    /// x = P*z + c
+    Eigen::VectorXd expandSolution(const Eigen::VectorXd& z) const;
+
+    /// The z corresponding to x, ignoring the eliminated entries of x
+    Eigen::VectorXd reduceGuess(const Eigen::VectorXd& x) const;
+
+    int num_original_vars() const { return P_.rows(); }
+    int num_reduced_vars() const { return P_.cols(); }
+    int num_fixed_vars() const { return num_fixed_; }
+    int num_aliased_vars() const { return num_aliased_; }
+    int num_eliminated_rows() const { return num_eliminated_rows_; }
+
+    /// The variable scale factors s, ones without scaling
+    const Eigen::VectorXd& variable_scale() const { return variable_scale_; }
+
+    const Eigen::SparseMatrix<double>& P() const { return P_; }
+    const Eigen::VectorXd& c() const { return c_; }
+
+  private:
+    // x_i = scale_[i]*x_{rep_[i]} + offset_[i]; rep_[i] == -1 if x_i is fixed
+    // at offset_[i], and rep_[i] == i for the free representatives
+    int find(int i);
+    void fix(int i, double value);
+    void alias(int i, int j, double scale, double offset);
+    bool reduceRow(const Eigen::Ref<const Eigen::RowVectorXd>& a, double b, const std::vector<int>& indices);
+
+    void computeVariableScale();
+    void buildReducedProgram();
+
+    // Rows P and c for the variables of a binding, restricted to the columns
+    // the binding depends on
+    void bindingMap(const solvers::VectorXDecisionVariable& variables, Eigen::MatrixXd* P,
+                    Eigen::VectorXd* c, solvers::VectorXDecisionVariable* z) const;
+
+    solvers::MathematicalProgram* prog_;
+    std::unique_ptr<solvers::MathematicalProgram> reduced_;
+    double tol_;
+    bool scaling_;
+
+    std::vector<int> rep_;
+    Eigen::VectorXd scale_;
+    Eigen::VectorXd offset_;
+    Eigen::VectorXd lb_;
+    Eigen::VectorXd ub_;
+    // for each linear equality binding, whether each row has been eliminated
+    std::vector<std::vector<bool>> row_eliminated_;
+
+    Eigen::SparseMatrix<double> P_;
+    Eigen::VectorXd c_;
+    // index into z of each representative, -1 otherwise
+    std::vector<int> z_index_;
+    solvers::VectorXDecisionVariable z_;
+    Eigen::VectorXd variable_scale_;
+    int num_fixed_{0};
+    int num_aliased_{0};
+    int num_eliminated_rows_{0};
+};
+
+}
+}
+}
@@ -0,0 +1,49 @@
+#include "dircon_solve_control.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace drake {
+namespace systems {
+namespace trajectory_optimization {
+
+void DirconSolveControl::reset() {
+  cancelled_.store(false);
+  evaluations_.store(0);
+  sweeps_.store(0);
+  infeasibility_.store(std::numeric_limits<double>::infinity());
+  cancellation_latency_.store(-1);
+  sweep_evaluations_ = 0;
+  sweep_violation_ = 0;
+}
+
+void DirconSolveControl::cancel() {
+  // the time is published before the flag, so the solver thread sees it
+  cancel_ticks_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  cancelled_.store(true, std::memory_order_release);
+}
+
+void DirconSolveControl::recordCancellation() {
+  if (!isCancelled() || cancellation_latency_.load(std::memory_order_relaxed) >= 0) {
+    return;
+  }
+  const std::chrono::steady_clock::time_point cancel_time(
+      std::chrono::steady_clock::duration(cancel_ticks_.load(std::memory_order_relaxed)));
+  std::chrono::duration<double> latency = std::chrono::steady_clock::now() - cancel_time;
+  cancellation_latency_.store(latency.count(), std::memory_order_relaxed);
+}
+
+void DirconSolveControl::recordEvaluation(double violation) {
+  evaluations_.fetch_add(1, std::memory_order_relaxed);
+  sweep_violation_ = std::max(sweep_violation_, violation);
+  if (++sweep_evaluations_ >= num_bindings_) {
+    infeasibility_.store(sweep_violation_, std::memory_order_relaxed);
+    sweeps_.fetch_add(1, std::memory_order_relaxed);
+    sweep_evaluations_ = 0;
+    sweep_violation_ = 0;
+  }
+}
+
+}  // namespace trajectory_optimization
+}  // namespace systems
+}  // namespace drake
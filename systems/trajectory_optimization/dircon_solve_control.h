@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+
+namespace drake {
+namespace systems {
+namespace trajectory_optimization {
+
+/// Progress reporting and cooperative cancellation of a solve, shared
+/// between a HybridDircon and its constraints. The constraints report each
+/// evaluation from the solver thread, and the progress may be read and
+/// cancel() called from any thread.
+///
+/// A sweep is one evaluation of every DIRCON binding of the program, as
+/// made by the solver for each trial point, so the number of sweeps tracks
+/// the solver's function evaluations (major iterations plus line search
+/// steps), and the infeasibility is that of the last trial point.
+///
+/// Cancellation is never signalled from inside the solver: the constraints
+/// only report progress, and HybridDircon::SolveAsync checks isCancelled()
+/// between the iteration-limited segments of its solve.
+class DirconSolveControl {
+ public:
+  /// Clears the cancellation request and the progress, before a solve
+  void reset();
+
+  /// Requests cancellation of the solve in progress
+  void cancel();
+
+  bool isCancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+  /// Records the time since cancel(), when the solve has stopped because of
+  /// it. Called by the solving thread.
+  void recordCancellation();
+
+  /// Number of binding evaluations since reset()
+  long getEvaluations() const { return evaluations_.load(std::memory_order_relaxed); }
+
+  /// Number of complete sweeps over the DIRCON bindings since reset()
+  long getSweeps() const { return sweeps_.load(std::memory_order_relaxed); }
+
+  /// The maximum constraint violation of the DIRCON bindings in the last
+  /// complete sweep, or infinity before the first
+  double getInfeasibility() const { return infeasibility_.load(std::memory_order_relaxed); }
+
+  /// Seconds from cancel() to the end of the solve it stopped, or a negative
+  /// value if no solve has been stopped since reset()
+  double getCancellationLatency() const { return cancellation_latency_.load(std::memory_order_relaxed); }
+
+  /// Registers a DIRCON binding, to be counted in each sweep
+  void addBinding() { num_bindings_++; }
+
+  int getNumBindings() const { return num_bindings_; }
+
+  /// Records an evaluation with the given constraint violation. Called by
+  /// the constraints, from the solver thread only.
+  void recordEvaluation(double violation);
+
+ private:
+  std::atomic<bool> cancelled_{false};
+  std::atomic<long> evaluations_{0};
+  std::atomic<long> sweeps_{0};
+  std::atomic<double> infeasibility_{std::numeric_limits<double>::infinity()};
+  std::atomic<double> cancellation_latency_{-1};
+  // steady_clock time of cancel(), as a count of ticks
+  std::atomic<std::chrono::steady_clock::rep> cancel_ticks_{0};
+  int num_bindings_{0};
+  // the sweep in progress, touched only by the solver thread
+  int sweep_evaluations_{0};
+  double sweep_violation_{0};
+};
+
+}  // namespace trajectory_optimization
+}  // namespace systems
+}  // namespace drake
@@ -1,5 +1,6 @@
 #include <memory>
 #include <chrono>
+#include <future>
 
 #include <gflags/gflags.h>
 #include "drake/systems/trajectory_optimization/direct_collocation.h"
@@ -23,6 +24,8 @@
 #include "dircon.h"
 #include "hybrid_dircon.h"
 #include "dircon_opt_constraints.h"
+#include "dircon_util.h"
+#include "dircon_presolve.h"
 #include "drake/solvers/mathematical_program.h"
 #include "drake/solvers/constraint.h"
 
@@ -39,9 +42,11 @@ using drake::systems::trajectory_optimization::DirconDynamicConstraint;
 using drake::systems::trajectory_optimization::DirconKinematicConstraint;
 using drake::systems::trajectory_optimization::DirconOptions;
 using drake::systems::trajectory_optimization::DirconKinConstraintType;
+using drake::systems::trajectory_optimization::DirconFiniteDifferenceType;
 using drake::trajectories::PiecewisePolynomial;
 
 DEFINE_int64(testIndex, 0, "The index of the test to run");
+DEFINE_int32(differenceType, 0, "Finite differencing for double constraints (0 forward, 1 central, 2 scaled forward)");
 
 //template VectorXd RigidBodyTree<double>::transformPointsJacobianDotTimesV<double, Matrix3Xd>(KinematicsCache<double> const&, Eigen::MatrixBase<Matrix3Xd> const&, int, int);
 
@@ -183,6 +188,458 @@ int testConstraints() {
   return 0;
 }
 
+int testLagrangianHessian() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int n = 4;
+  int nu = 1;
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraintd = DirconPositionData<AutoDiffXd>(tree,bodyIdx,pt,isXZ);
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<AutoDiffXd>*> constraintsd;
+  constraintsd.push_back(&constraintd);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto datasetd = DirconKinematicDataSet<AutoDiffXd>(tree, &constraintsd);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+  int nl = dataset.countConstraints();
+
+  auto dynamicConstraintd = std::make_shared<DirconDynamicConstraint<AutoDiffXd>>(tree, datasetd);
+  auto dynamicConstraint = std::make_shared<DirconDynamicConstraint<double>>(tree, dataset);
+
+  VectorXd vars = VectorXd::Random(1 + 4*n + 2*nu + 4*nl);
+  vars(0) = .1;
+  VectorXd lambda = VectorXd::Random(2*n);
+
+  MatrixXd H_autodiff;
+  auto start = std::chrono::high_resolution_clock::now();
+  dynamicConstraintd->EvalLagrangianHessian(vars, lambda, &H_autodiff);
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed_autodiff = finish - start;
+
+  // check against second differences of lambda^T y with the double constraint,
+  // H_ij = (f(x+e_i+e_j) - f(x+e_i) - f(x+e_j) + f(x))/dx^2
+  const double dx = 1e-4;
+  auto f = [&](const VectorXd& x) {
+    VectorXd y;
+    dynamicConstraint->Eval(x, y);
+    return lambda.dot(y);
+  };
+  const int num_vars = vars.size();
+  const double f0 = f(vars);
+  VectorXd fi(num_vars);
+  for (int i = 0; i < num_vars; i++) {
+    fi(i) = f(vars + dx*VectorXd::Unit(num_vars, i));
+  }
+  MatrixXd H_double(num_vars, num_vars);
+  for (int i = 0; i < num_vars; i++) {
+    for (int j = 0; j <= i; j++) {
+      H_double(i,j) = (f(vars + dx*(VectorXd::Unit(num_vars, i) + VectorXd::Unit(num_vars, j))) - fi(i) - fi(j) + f0)/
+          (dx*dx);
+      H_double(j,i) = H_double(i,j);
+    }
+  }
+
+  cout << "*********** H (autodiff)  ***********" << endl;
+  cout << H_autodiff << endl;
+  cout << "Hessian time (autodiff): " << elapsed_autodiff.count() << endl;
+  cout << "Max difference from second differences: " << (H_autodiff - H_double).cwiseAbs().maxCoeff() << endl;
+  cout << "Max |H|: " << H_autodiff.cwiseAbs().maxCoeff() << endl;
+
+  return 0;
+}
+
+int testFiniteDifferences() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int n = 4;
+  int nu = 1;
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraintd = DirconPositionData<AutoDiffXd>(tree,bodyIdx,pt,isXZ);
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<AutoDiffXd>*> constraintsd;
+  constraintsd.push_back(&constraintd);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto datasetd = DirconKinematicDataSet<AutoDiffXd>(tree, &constraintsd);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+  int nl = dataset.countConstraints();
+
+  auto dynamicConstraintd = std::make_shared<DirconDynamicConstraint<AutoDiffXd>>(tree, datasetd);
+  auto dynamicConstraint = std::make_shared<DirconDynamicConstraint<double>>(tree, dataset);
+
+  VectorXd vars = VectorXd::Random(1 + 4*n + 2*nu + 4*nl);
+  vars(0) = .1;
+  AutoDiffVecXd vars_autodiff = math::initializeAutoDiff(vars);
+
+  AutoDiffVecXd y_autodiff;
+  dynamicConstraintd->Eval(vars_autodiff, y_autodiff);
+  MatrixXd dy_exact = math::autoDiffToGradientMatrix(y_autodiff);
+
+  std::vector<std::string> names = {"forward", "central", "scaled forward"};
+  std::vector<DirconFiniteDifferenceType> types = {DirconFiniteDifferenceType::kForwardDifference,
+      DirconFiniteDifferenceType::kCentralDifference, DirconFiniteDifferenceType::kScaledForwardDifference};
+  for (int i = 0; i < 3; i++) {
+    dynamicConstraint->setFiniteDifference(types[i]);
+    AutoDiffVecXd y;
+    auto start = std::chrono::high_resolution_clock::now();
+    dynamicConstraint->Eval(vars_autodiff, y);
+    auto finish = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = finish - start;
+    MatrixXd gradient_error = math::autoDiffToGradientMatrix(y) - dy_exact;
+    cout << names[i] << " (dx = " << dynamicConstraint->getFiniteDifferenceStep() << "): max gradient error " <<
+        gradient_error.cwiseAbs().maxCoeff() << ", time " << elapsed.count() << endl;
+  }
+
+  return 0;
+}
+
+int testColoredFiniteDifferences() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+  auto options = DirconOptions(dataset.countConstraints());
+
+  for (int N : {11, 41}) {
+    auto trajopt = std::make_shared<Dircon<double>>(tree, N, .02, .3, dataset, options);
+    systems::trajectory_optimization::dircon::SparseLinearization linearization(trajopt.get());
+    VectorXd z = VectorXd::Random(trajopt->num_vars());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    linearization.update(z);
+    auto finish = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed_full = finish - start;
+    MatrixXd A_full = MatrixXd(linearization.jacobian());
+
+    start = std::chrono::high_resolution_clock::now();
+    linearization.updateFiniteDifference(z);
+    finish = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed_colored = finish - start;
+
+    cout << "N = " << N << ", variables: " << trajopt->num_vars() << ", colors: " << linearization.num_colors() << endl;
+    cout << "update() time (AutoDiff, per-binding differences): " << elapsed_full.count() << endl;
+    cout << "Colored differences time: " << elapsed_colored.count() << endl;
+    cout << "Max Jacobian difference: " << (MatrixXd(linearization.jacobian()) - A_full).cwiseAbs().maxCoeff() << endl;
+  }
+  return 0;
+}
+
+int testKnotInterleavedForces() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+
+  // Fill-in of the Cholesky factor of J^T*J + I without reordering, as a
+  // measure of how the variable order alone affects a sparse factorization
+  for (int N : {41, 161}) {
+    for (bool interleaved : {false, true}) {
+      auto options = DirconOptions(dataset.countConstraints());
+      options.setKnotInterleavedForces(interleaved);
+      auto trajopt = std::make_shared<Dircon<double>>(tree, N, .02, .3, dataset, options);
+      systems::trajectory_optimization::dircon::SparseLinearization linearization(trajopt.get());
+      linearization.update(VectorXd::Random(trajopt->num_vars()));
+
+      Eigen::SparseMatrix<double> JtJ = linearization.jacobian().transpose()*linearization.jacobian();
+      Eigen::SparseMatrix<double> I(JtJ.rows(), JtJ.cols());
+      I.setIdentity();
+      JtJ += I;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      Eigen::SimplicialLLT<Eigen::SparseMatrix<double>, Eigen::Lower, Eigen::NaturalOrdering<int>> llt(JtJ);
+      auto finish = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double> elapsed = finish - start;
+      Eigen::SparseMatrix<double> L = llt.matrixL();
+
+      cout << "N = " << N << (interleaved ? ", interleaved" : ", blocked") <<
+          ": nnz(J) = " << linearization.num_nonzeros() << ", nnz(L) = " << L.nonZeros() <<
+          ", factorization time: " << elapsed.count() << endl;
+    }
+  }
+  return 0;
+}
+
+int testPresolve() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+  auto options = DirconOptions(dataset.countConstraints());
+
+  auto trajopt = std::make_shared<Dircon<double>>(tree, 21, .02, .3, dataset, options);
+  auto x0 = trajopt->initial_state();
+  auto xf = trajopt->final_state();
+  for (int i = 0; i < 4; i++) {
+    trajopt->AddLinearConstraint(x0(i) == 0);
+    trajopt->AddLinearConstraint(xf(i) == -x0(i + 4));
+  }
+
+  systems::trajectory_optimization::DirconPresolve presolve(trajopt.get());
+  cout << "Variables: " << presolve.num_original_vars() << " -> " << presolve.num_reduced_vars() << endl;
+  cout << "Fixed: " << presolve.num_fixed_vars() << ", aliased: " << presolve.num_aliased_vars() <<
+      ", eliminated rows: " << presolve.num_eliminated_rows() << endl;
+
+  // The reduced nonlinear constraints must match the original ones at x = P*z + c
+  auto reduced = presolve.reduced_program();
+  VectorXd z = VectorXd::Random(presolve.num_reduced_vars());
+  VectorXd x = presolve.expandSolution(z);
+  MatrixXd A, A_reduced;
+  VectorXd y, y_reduced, lb, ub;
+  systems::trajectory_optimization::dircon::linearizeConstraints(trajopt.get(), x, y, A, lb, ub);
+  systems::trajectory_optimization::dircon::linearizeConstraints(reduced, z, y_reduced, A_reduced, lb, ub);
+  int n_generic = 0;
+  for (auto const& binding : trajopt->generic_constraints()) {
+    n_generic += binding.evaluator()->num_constraints();
+  }
+  cout << "Max generic constraint difference: " <<
+      (y.tail(n_generic) - y_reduced.tail(n_generic)).cwiseAbs().maxCoeff() << endl;
+  cout << "Max generic Jacobian difference: " <<
+      (A.bottomRows(n_generic)*presolve.P() - A_reduced.bottomRows(n_generic)).cwiseAbs().maxCoeff() << endl;
+
+  // Scaling must not change the expanded solution
+  trajopt->SetInitialGuessForAllVariables(VectorXd::Random(trajopt->num_vars()));
+  systems::trajectory_optimization::DirconPresolve scaled(trajopt.get(), true);
+  VectorXd z_scaled = scaled.reduceGuess(presolve.expandSolution(z));
+  cout << "Variable scale range: [" << scaled.variable_scale().minCoeff() << ", " <<
+      scaled.variable_scale().maxCoeff() << "]" << endl;
+  cout << "Max expanded solution difference with scaling: " <<
+      (scaled.expandSolution(z_scaled) - x).cwiseAbs().maxCoeff() << endl;
+  return 0;
+}
+
+int testProjectInitialGuess() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+  auto options = DirconOptions(dataset.countConstraints());
+
+  auto trajopt = std::make_shared<Dircon<double>>(tree, 11, .02, .3, dataset, options);
+  trajopt->SetInitialGuessForAllVariables(VectorXd::Random(trajopt->num_vars()));
+  trajopt->SetInitialGuess(trajopt->h_vars(), VectorXd::Constant(trajopt->N() - 1, .1));
+
+  // violation of the kinematic constraints (position, velocity and
+  // acceleration) at the initial guess
+  auto maxViolation = [&]() {
+    double violation = 0;
+    for (auto const& binding : trajopt->generic_constraints()) {
+      auto c = std::dynamic_pointer_cast<DirconKinematicConstraint<double>>(binding.evaluator());
+      if (c) {
+        VectorXd y;
+        c->Eval(trajopt->GetInitialGuess(binding.variables()), y);
+        violation = std::max(violation, std::max((c->lower_bound() - y).maxCoeff(), (y - c->upper_bound()).maxCoeff()));
+      }
+    }
+    return violation;
+  };
+
+  cout << "Max kinematic constraint violation before projection: " << maxViolation() << endl;
+  trajopt->ProjectInitialGuess();
+  cout << "Max kinematic constraint violation after projection: " << maxViolation() << endl;
+  return 0;
+}
+
+int testInverseDynamics() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<AutoDiffXd>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<AutoDiffXd>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<AutoDiffXd>(tree, &constraints);
+
+  // Forward and inverse-dynamics formulations of the same program, from the
+  // same projected (dynamically consistent) initial guess
+  const int N = 21;
+  const int iterations = 20;
+  const VectorXd x0 = VectorXd::Random(tree.get_num_positions() + tree.get_num_velocities());
+  for (bool inverse : {false, true}) {
+    auto options = DirconOptions(dataset.countConstraints());
+    options.setInverseDynamics(inverse);
+    auto trajopt = std::make_shared<Dircon<AutoDiffXd>>(tree, N, .02, .3, dataset, options);
+    trajopt->SetInitialGuessForAllVariables(VectorXd::Zero(trajopt->num_vars()));
+    trajopt->SetInitialGuess(trajopt->h_vars(), VectorXd::Constant(N - 1, .1));
+    for (int i = 0; i < N; i++) {
+      trajopt->SetInitialGuess(trajopt->state(i), x0);
+    }
+    trajopt->ProjectInitialGuess();
+
+    int num_rows = 0;
+    double violation = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < iterations; k++) {
+      for (auto const& binding : trajopt->generic_constraints()) {
+        AutoDiffVecXd y;
+        binding.evaluator()->Eval(math::initializeAutoDiff(trajopt->GetInitialGuess(binding.variables())), y);
+        if (k == 0) {
+          const VectorXd y_val = math::autoDiffToValueMatrix(y);
+          num_rows += y.size();
+          violation = std::max(violation, std::max((binding.evaluator()->lower_bound() - y_val).maxCoeff(),
+                                                   (y_val - binding.evaluator()->upper_bound()).maxCoeff()));
+        }
+      }
+    }
+    auto finish = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = finish - start;
+
+    cout << (inverse ? "Inverse dynamics" : "Forward dynamics") << ": " << trajopt->num_vars() << " variables, " <<
+        num_rows << " constraint rows, max violation at the projected guess " << violation <<
+        ", constraint and gradient evaluation time: " << elapsed.count()/iterations << endl;
+  }
+  return 0;
+}
+
+int testEvaluationStatistics() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<double>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<double>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<double>(tree, &constraints);
+
+  // The same program with and without statistics, evaluated once with double
+  // and twice with AutoDiffXd at the same point
+  const int N = 11;
+  auto options = DirconOptions(dataset.countConstraints());
+  auto trajopt = std::make_shared<Dircon<double>>(tree, N, .02, .3, dataset, options);
+  options.setEvaluationStatistics(true);
+  auto counted_trajopt = std::make_shared<Dircon<double>>(tree, N, .02, .3, dataset, options);
+  const VectorXd z = VectorXd::Random(trajopt->num_vars());
+
+  double max_difference = 0;
+  for (int i = 0; i < static_cast<int>(trajopt->generic_constraints().size()); i++) {
+    auto const& binding = trajopt->generic_constraints()[i];
+    auto const& counted_binding = counted_trajopt->generic_constraints()[i];
+    VectorXd y, y_counted;
+    AutoDiffVecXd y_t;
+    binding.evaluator()->Eval(z.head(binding.variables().size()), y);
+    counted_binding.evaluator()->Eval(z.head(counted_binding.variables().size()), y_counted);
+    counted_binding.evaluator()->Eval(math::initializeAutoDiff(z.head(counted_binding.variables().size())), y_t);
+    counted_binding.evaluator()->Eval(math::initializeAutoDiff(z.head(counted_binding.variables().size())), y_t);
+    max_difference = std::max(max_difference, (y - y_counted).cwiseAbs().maxCoeff());
+  }
+
+  auto statistics = counted_trajopt->GetEvaluationStatistics();
+  bool counts_match = statistics.size() == counted_trajopt->generic_constraints().size();
+  for (auto const& binding_statistics : statistics) {
+    counts_match = counts_match && binding_statistics.value_evaluations == 1 &&
+        binding_statistics.gradient_evaluations == 2;
+  }
+  cout << statistics.size() << " counted bindings, counts " << (counts_match ? "match" : "DO NOT match") <<
+      ", max value difference " << max_difference << endl;
+  counted_trajopt->WriteEvaluationStatisticsCsv(cout);
+
+  counted_trajopt->ResetEvaluationStatistics();
+  for (auto const& binding_statistics : counted_trajopt->GetEvaluationStatistics()) {
+    counts_match = counts_match && binding_statistics.value_evaluations == 0 &&
+        binding_statistics.gradient_evaluations == 0;
+  }
+  return counts_match ? 0 : 1;
+}
+
+int testSolveAsync() {
+  RigidBodyTree<double> tree;
+  parsers::urdf::AddModelInstanceFromUrdfFileToWorld("../../examples/Acrobot/Acrobot_floating.urdf", multibody::joints::kFixed, &tree);
+
+  int bodyIdx = 4;
+  Vector3d pt;
+  pt << 0,0,0;
+  bool isXZ = true;
+  auto constraint = DirconPositionData<AutoDiffXd>(tree,bodyIdx,pt,isXZ);
+  std::vector<DirconKinematicData<AutoDiffXd>*> constraints;
+  constraints.push_back(&constraint);
+  auto dataset = DirconKinematicDataSet<AutoDiffXd>(tree, &constraints);
+
+  // A swing-up solve in segments of 5 major iterations, cancelled from this
+  // thread once it has made some progress (or after a second)
+  const int N = 41;
+  auto options = DirconOptions(dataset.countConstraints());
+  auto trajopt = std::make_shared<Dircon<AutoDiffXd>>(tree, N, .02, .3, dataset, options);
+  VectorXd x0 = VectorXd::Zero(8);
+  VectorXd xf = VectorXd::Zero(8);
+  xf(2) = M_PI;
+  trajopt->AddLinearConstraint(trajopt->initial_state() == x0);
+  trajopt->AddLinearConstraint(trajopt->final_state() == xf);
+  auto u = trajopt->input();
+  trajopt->AddRunningCost(u.transpose()*u);
+  trajopt->SetInitialGuessForAllVariables(VectorXd::Random(trajopt->num_vars()));
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto future = trajopt->SolveAsync(5);
+  const auto& control = trajopt->solve_control();
+  while (future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready &&
+         control.getSweeps() < 5 &&
+         std::chrono::high_resolution_clock::now() - start < std::chrono::seconds(1)) {
+  }
+  const long sweeps_at_cancel = control.getSweeps();
+  trajopt->CancelSolve();
+  const solvers::SolutionResult result = future.get();
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = finish - start;
+
+  cout << control.getNumBindings() << " DIRCON bindings. Cancelled after " << sweeps_at_cancel << " sweeps (" <<
+      control.getEvaluations() << " evaluations), infeasibility " << control.getInfeasibility() << endl;
+  cout << "Result " << result << (control.isCancelled() ? " (cancelled)" : "") << ", cancellation latency " <<
+      control.getCancellationLatency() << " s, total " << elapsed.count() << " s" << endl;
+
+  // a solve that finished before the cancellation reports no latency
+  bool consistent = control.getCancellationLatency() < 0 || result == solvers::kIterationLimit;
+
+  // the cancellation does not carry over to a plain solve
+  const long evaluations = control.getEvaluations();
+  trajopt->SetSolverOption(drake::solvers::SnoptSolver::id(), "Major iterations limit", 5);
+  trajopt->Solve();
+  consistent = consistent && control.getEvaluations() > evaluations;
+  cout << "Plain solve after the cancellation: " << control.getEvaluations() - evaluations << " evaluations" << endl;
+  return consistent ? 0 : 1;
+}
+
 template <typename T>
 int testDircon(bool addForceConstraints, Eigen::VectorXd x0 = Eigen::VectorXd::Zero(8)) {
   RigidBodyTree<double> tree;
@@ -219,6 +676,7 @@ int testDircon(bool addForceConstraints, Eigen::VectorXd x0 = Eigen::VectorXd::Z
   auto options = DirconOptions(dataset.countConstraints());
   options.setStartType(DirconKinConstraintType::kAccelOnly);
   options.setEndType(DirconKinConstraintType::kAccelOnly);
+  options.setFiniteDifference(static_cast<DirconFiniteDifferenceType>(FLAGS_differenceType));
   //options.setConstraintRelative(0,true);
   auto trajopt = std::make_shared<Dircon<T>>(tree, N, .02, .3, dataset, options);
 
@@ -772,12 +1230,40 @@ int main(int argc, char* argv[]) {
       std::cout << "Testing hybrid DIRCON (Acrobot, one mode) with double" << std::endl;
       drake::dircon::examples::testHybridDircon<double>(false);
       break;
-    case 8:
+    case 8: {
       Eigen::VectorXd init_jump = Eigen::VectorXd(8);
       init_jump << 0, 0, M_PI*3/4, M_PI/2, 0, 0, 0, 0;
       std::cout << "Testing hybrid DIRCON (Acrobot, three modes jumping then swingup) with double" << std::endl;
       drake::dircon::examples::testHybridDirconJump<double>(true);
       break;
+    }
+    case 9:
+      std::cout << "Testing Lagrangian Hessian of the dynamic constraint" << std::endl;
+      return drake::dircon::examples::testLagrangianHessian();
+    case 10:
+      std::cout << "Testing finite difference gradients against AutoDiffXd" << std::endl;
+      return drake::dircon::examples::testFiniteDifferences();
+    case 11:
+      std::cout << "Testing colored finite differences of a whole DIRCON program" << std::endl;
+      return drake::dircon::examples::testColoredFiniteDifferences();
+    case 12:
+      std::cout << "Testing knot-interleaved force variables" << std::endl;
+      return drake::dircon::examples::testKnotInterleavedForces();
+    case 13:
+      std::cout << "Testing presolve of a DIRCON program" << std::endl;
+      return drake::dircon::examples::testPresolve();
+    case 14:
+      std::cout << "Testing projection of the initial guess onto the constraints" << std::endl;
+      return drake::dircon::examples::testProjectInitialGuess();
+    case 15:
+      std::cout << "Testing the inverse-dynamics formulation against forward dynamics" << std::endl;
+      return drake::dircon::examples::testInverseDynamics();
+    case 16:
+      std::cout << "Testing per-binding evaluation statistics" << std::endl;
+      return drake::dircon::examples::testEvaluationStatistics();
+    case 17:
+      std::cout << "Testing asynchronous, cancelled solve" << std::endl;
+      return drake::dircon::examples::testSolveAsync();
   }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "dircon_trace.h"
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace drake {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  double start_us;
+  double duration_us;
+  size_t thread;
+};
+
+struct TraceState {
+  std::atomic<bool> recording{false};
+  std::chrono::steady_clock::time_point origin;
+  std::mutex mutex;
+  std::vector<TraceEvent> events;
+};
+
+TraceState& state() {
+  static TraceState trace_state;
+  return trace_state;
+}
+
+// Escapes the characters that are not allowed unescaped in a JSON string
+std::string jsonString(const char* s) {
+  std::string escaped;
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      escaped += '\\';
+    }
+    escaped += *s;
+  }
+  return escaped;
+}
+
+}
+
+void DirconTrace::start() {
+  TraceState& trace = state();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  trace.events.clear();
+  trace.origin = std::chrono::steady_clock::now();
+  trace.recording.store(true, std::memory_order_release);
+}
+
+bool DirconTrace::stop(const std::string& filename) {
+  TraceState& trace = state();
+  trace.recording.store(false, std::memory_order_release);
+  std::lock_guard<std::mutex> lock(trace.mutex);
+
+  std::ofstream file(filename);
+  if (!file) {
+    return false;
+  }
+
+  // thread ids are hashed, so relabel them 0, 1, ... in order of appearance
+  std::vector<size_t> threads;
+  file << "{\"traceEvents\":[";
+  for (size_t i = 0; i < trace.events.size(); i++) {
+    const TraceEvent& event = trace.events[i];
+    size_t tid = 0;
+    while (tid < threads.size() && threads[tid] != event.thread) {
+      tid++;
+    }
+    if (tid == threads.size()) {
+      threads.push_back(event.thread);
+    }
+    file << (i ? ",\n" : "\n") << "{\"name\":\"" << jsonString(event.name) <<
+        "\",\"cat\":\"dircon\",\"ph\":\"X\",\"ts\":" << event.start_us <<
+        ",\"dur\":" << event.duration_us << ",\"pid\":0,\"tid\":" << tid << "}";
+  }
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return static_cast<bool>(file);
+}
+
+bool DirconTrace::isRecording() {
+  return state().recording.load(std::memory_order_relaxed);
+}
+
+bool DirconTrace::isCompiledIn() {
+#ifdef DIRCON_ENABLE_TRACING
+  return true;
+#else
+  return false;
+#endif
+}
+
+int DirconTrace::numEvents() {
+  TraceState& trace = state();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  return trace.events.size();
+}
+
+void DirconTrace::record(const char* name, double start_us, double duration_us) {
+  TraceState& trace = state();
+  const size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  trace.events.push_back({name, start_us, duration_us, thread});
+}
+
+double DirconTrace::now() {
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - state().origin;
+  return elapsed.count();
+}
+
+DirconTraceScope::DirconTraceScope(const char* name) :
+    name_(name), start_(0), recording_(DirconTrace::isRecording()) {
+  if (recording_) {
+    start_ = DirconTrace::now();
+  }
+}
+
+DirconTraceScope::~DirconTraceScope() {
+  // events still open when stop() is called are dropped
+  if (recording_ && DirconTrace::isRecording()) {
+    DirconTrace::record(name_, start_, DirconTrace::now() - start_);
+  }
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+/// Scoped tracing of the DIRCON evaluation, written as Chrome trace-event JSON
+/// (viewable in chrome://tracing or Perfetto).
+///
+/// DIRCON_TRACE_SCOPE(name) records the wall-clock duration of the enclosing
+/// scope under @p name, which must be a string literal. The scopes are only
+/// compiled in when DIRCON_ENABLE_TRACING is defined (the CMake option of the
+/// same name, or --define=dircon_tracing=on with Bazel); otherwise the macro
+/// expands to nothing. When compiled in, scopes record nothing until
+/// DirconTrace::start() is called, at the cost of one atomic load per scope.
+///
+/// Example:
+///   DirconTrace::start();
+///   solver.Solve(*trajopt);
+///   DirconTrace::stop("dircon_trace.json");
+namespace drake {
+
+class DirconTrace {
+  public:
+    /// Clears any recorded events and starts recording
+    static void start();
+
+    /// Stops recording and writes the recorded events to @p filename.
+    /// Returns false if the file could not be written.
+    static bool stop(const std::string& filename);
+
+    /// True between start() and stop()
+    static bool isRecording();
+
+    /// True if the library was built with DIRCON_ENABLE_TRACING
+    static bool isCompiledIn();
+
+    /// Number of events recorded since start()
+    static int numEvents();
+
+    /// Records a complete event, with times in microseconds since start()
+    static void record(const char* name, double start_us, double duration_us);
+
+    /// Microseconds since start()
+    static double now();
+};
+
+/// Records the lifetime of the object as a trace event
+class DirconTraceScope {
+  public:
+    explicit DirconTraceScope(const char* name);
+    ~DirconTraceScope();
+
+    DirconTraceScope(const DirconTraceScope&) = delete;
+    DirconTraceScope& operator=(const DirconTraceScope&) = delete;
+
+  private:
+    const char* name_;
+    double start_;
+    bool recording_;
+};
+
+}
+
+#define DIRCON_TRACE_CONCAT_INNER(a, b) a##b
+#define DIRCON_TRACE_CONCAT(a, b) DIRCON_TRACE_CONCAT_INNER(a, b)
+
+#ifdef DIRCON_ENABLE_TRACING
+#define DIRCON_TRACE_SCOPE(name) \
+  ::drake::DirconTraceScope DIRCON_TRACE_CONCAT(dircon_trace_scope_, __LINE__)(name)
+#else
+#define DIRCON_TRACE_SCOPE(name) do {} while (0)
+#endif
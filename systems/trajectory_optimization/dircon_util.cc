@@ -1,5 +1,9 @@
 #include "dircon_util.h"
 
+#include <fstream>
+#include <set>
+#include <sstream>
+
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 using drake::solvers::Constraint;
@@ -99,6 +103,80 @@ double secondOrderCost(const solvers::MathematicalProgram* prog, VectorXd& x,
 }
 
 
+//form the Hessian of the constraint part of the Lagrangian
+// H = sum_i lambda_i * d^2/dz^2 y_i(z)
+// Linear and bounding box constraints contribute nothing, but are counted so
+// that lambda lines up with the rows of linearizeConstraints
+void secondOrderLagrangian(const solvers::MathematicalProgram* prog, VectorXd& x,
+  VectorXd& lambda, MatrixXd& H) {
+
+  int num_vars = prog->num_vars();
+  H = Eigen::MatrixXd::Zero(num_vars, num_vars);
+
+  int constraint_index = 0;
+  constraint_index += countConstraints(prog, prog->bounding_box_constraints());
+  constraint_index += countConstraints(prog, prog->linear_constraints());
+  constraint_index += countConstraints(prog, prog->linear_equality_constraints());
+
+  std::vector<Binding<Constraint>> nonlinear_constraints;
+  for (auto const& binding : prog->lorentz_cone_constraints()) {
+    nonlinear_constraints.push_back(binding);
+  }
+  for (auto const& binding : prog->generic_constraints()) {
+    nonlinear_constraints.push_back(binding);
+  }
+
+  for (auto const& binding : nonlinear_constraints) {
+    auto const& c = binding.evaluator();
+    int n = c->num_constraints();
+    auto variables = binding.variables();
+    VectorXd x_binding(variables.size());
+    for (int i=0; i < variables.size(); i++) {
+      x_binding(i) = x(prog->FindDecisionVariableIndex(variables(i)));
+    }
+    VectorXd lambda_binding = lambda.segment(constraint_index, n);
+    constraint_index += n;
+    if (lambda_binding.isZero(0))
+      continue;
+
+    MatrixXd H_binding;
+    // look through the wrapper used for evaluation statistics
+    auto counting = std::dynamic_pointer_cast<DirconCountingConstraint>(c);
+    const std::shared_ptr<Constraint> wrapped = counting ? counting->constraint() : c;
+    auto dircon_autodiff = std::dynamic_pointer_cast<DirconAbstractConstraint<AutoDiffXd>>(wrapped);
+    auto dircon_double = std::dynamic_pointer_cast<DirconAbstractConstraint<double>>(wrapped);
+    if (dircon_autodiff) {
+      dircon_autodiff->EvalLagrangianHessian(x_binding, lambda_binding, &H_binding);
+    } else if (dircon_double) {
+      dircon_double->EvalLagrangianHessian(x_binding, lambda_binding, &H_binding);
+    } else {
+      // central differencing of the AutoDiff gradients, an approximation as
+      // for the DIRCON constraints
+      double dx = 1e-6;
+      AutoDiffVecXd x_val = math::initializeAutoDiff(x_binding);
+      AutoDiffVecXd yp, ym;
+      H_binding.resize(variables.size(), variables.size());
+      for (int i = 0; i < variables.size(); i++) {
+        x_val(i).value() += dx/2;
+        c->Eval(x_val, yp);
+        x_val(i).value() -= dx;
+        c->Eval(x_val, ym);
+        x_val(i).value() += dx/2;
+        H_binding.col(i) = (math::autoDiffToGradientMatrix(yp) -
+            math::autoDiffToGradientMatrix(ym)).transpose()*lambda_binding/dx;
+      }
+      H_binding = 0.5*(H_binding + H_binding.transpose());
+    }
+
+    for (int i = 0; i < variables.size(); i++) {
+      for (int j = 0; j < variables.size(); j++) {
+        H(prog->FindDecisionVariableIndex(variables(i)),
+          prog->FindDecisionVariableIndex(variables(j))) += H_binding(i,j);
+      }
+    }
+  }
+}
+
 // Evaluate all constraints and construct a linearization of them
 void linearizeConstraints(const solvers::MathematicalProgram* prog, VectorXd& x,
   VectorXd& y, MatrixXd& A, VectorXd& lb, VectorXd& ub) {
@@ -128,6 +206,305 @@ void linearizeConstraints(const solvers::MathematicalProgram* prog, VectorXd& x,
   constraint_index = updateConstraints(prog, prog->generic_constraints(), x, y, A, lb, ub, constraint_index);
 }
 
+SparseLinearization::SparseLinearization(const solvers::MathematicalProgram* prog) :
+    prog_(prog), num_constraints_(0), num_vars_(prog->num_vars()) {
+  int n = 0;
+  n += countConstraints(prog, prog->bounding_box_constraints());
+  n += countConstraints(prog, prog->linear_constraints());
+  n += countConstraints(prog, prog->linear_equality_constraints());
+  n += countConstraints(prog, prog->lorentz_cone_constraints());
+  n += countConstraints(prog, prog->generic_constraints());
+  y_ = VectorXd::Zero(n);
+  lb_.resize(n);
+  ub_.resize(n);
+
+  std::vector<double> values;
+  addLinear(prog->bounding_box_constraints(), &values);
+  addLinear(prog->linear_constraints(), &values);
+  addLinear(prog->linear_equality_constraints(), &values);
+
+  num_linear_rows_ = num_constraints_;
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int i = 0; i < static_cast<int>(values.size()); i++) {
+    triplets.push_back(Eigen::Triplet<double>(rows_[i], cols_[i], values[i]));
+  }
+  linear_A_.resize(num_linear_rows_, num_vars_);
+  linear_A_.setFromTriplets(triplets.begin(), triplets.end());
+
+  addNonlinear(prog->lorentz_cone_constraints(), &values);
+  addNonlinear(prog->generic_constraints(), &values);
+  DRAKE_ASSERT(num_constraints_ == n);
+  values_ = Eigen::Map<VectorXd>(values.data(), values.size());
+
+  // Build the compressed pattern once, and record where each triplet lands
+  triplets.clear();
+  for (int i = 0; i < num_nonzeros(); i++) {
+    triplets.push_back(Eigen::Triplet<double>(rows_[i], cols_[i], 0));
+  }
+  jacobian_.resize(num_constraints_, num_vars_);
+  jacobian_.setFromTriplets(triplets.begin(), triplets.end());
+  jacobian_.makeCompressed();
+  jacobian_index_.resize(num_nonzeros());
+  for (int i = 0; i < num_nonzeros(); i++) {
+    jacobian_index_[i] = &jacobian_.coeffRef(rows_[i], cols_[i]) - jacobian_.valuePtr();
+  }
+
+  colorColumns();
+}
+
+// Greedy coloring of the column intersection graph of the nonlinear rows:
+// two variables conflict if they share a nonlinear row. The Jacobian block of
+// each binding is dense, so this is when they appear in a common binding
+void SparseLinearization::colorColumns() {
+  std::vector<std::vector<int>> column_bindings(num_vars_);
+  for (int b = 0; b < static_cast<int>(nonlinear_.size()); b++) {
+    for (int index : nonlinear_[b].var_indices) {
+      if (column_bindings[index].empty() || column_bindings[index].back() != b)
+        column_bindings[index].push_back(b);
+    }
+  }
+
+  color_ = std::vector<int>(num_vars_, -1);
+  std::vector<int> forbidden;
+  for (int col = 0; col < num_vars_; col++) {
+    if (column_bindings[col].empty())
+      continue;
+    for (int b : column_bindings[col]) {
+      for (int index : nonlinear_[b].var_indices) {
+        if (color_[index] >= 0) {
+          if (static_cast<int>(forbidden.size()) <= color_[index])
+            forbidden.resize(color_[index] + 1, -1);
+          forbidden[color_[index]] = col;
+        }
+      }
+    }
+    int color = 0;
+    while (color < static_cast<int>(forbidden.size()) && forbidden[color] == col)
+      color++;
+    color_[col] = color;
+    if (static_cast<int>(color_columns_.size()) <= color)
+      color_columns_.resize(color + 1);
+    color_columns_[color].push_back(col);
+  }
+}
+
+template <typename Derived>
+void SparseLinearization::addLinear(const std::vector<Binding<Derived>>& constraints,
+    std::vector<double>* values) {
+  for (auto const& binding : constraints) {
+    auto const& c = binding.evaluator();
+    int n = c->num_constraints();
+    lb_.segment(num_constraints_, n) = c->lower_bound();
+    ub_.segment(num_constraints_, n) = c->upper_bound();
+
+    auto variables = binding.variables();
+    const MatrixXd A = c->A();
+    for (int j = 0; j < variables.size(); j++) {
+      int col = prog_->FindDecisionVariableIndex(variables(j));
+      for (int i = 0; i < n; i++) {
+        if (A(i,j) != 0) {
+          rows_.push_back(num_constraints_ + i);
+          cols_.push_back(col);
+          values->push_back(A(i,j));
+        }
+      }
+    }
+    num_constraints_ += n;
+  }
+}
+
+template <typename Derived>
+void SparseLinearization::addNonlinear(const std::vector<Binding<Derived>>& constraints,
+    std::vector<double>* values) {
+  for (auto const& binding : constraints) {
+    auto const& c = binding.evaluator();
+    int n = c->num_constraints();
+    lb_.segment(num_constraints_, n) = c->lower_bound();
+    ub_.segment(num_constraints_, n) = c->upper_bound();
+
+    BindingData data;
+    data.evaluator = c;
+    data.row_start = num_constraints_;
+    data.value_start = rows_.size();
+    auto variables = binding.variables();
+    for (int j = 0; j < variables.size(); j++) {
+      data.var_indices.push_back(prog_->FindDecisionVariableIndex(variables(j)));
+    }
+    data.x = math::initializeAutoDiff(VectorXd::Zero(variables.size()));
+    data.x_double.resize(variables.size());
+    for (int j = 0; j < variables.size(); j++) {
+      data.first_occurrence.push_back(
+          std::find(data.var_indices.begin(), data.var_indices.begin() + j, data.var_indices[j]) ==
+          data.var_indices.begin() + j);
+    }
+
+    // dense block, stored row by row
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < variables.size(); j++) {
+        rows_.push_back(num_constraints_ + i);
+        cols_.push_back(data.var_indices[j]);
+        values->push_back(0);
+      }
+    }
+    nonlinear_.push_back(data);
+    num_constraints_ += n;
+  }
+}
+
+void SparseLinearization::update(const Eigen::Ref<const VectorXd>& x) {
+  DRAKE_ASSERT(x.size() == num_vars_);
+  y_.head(num_linear_rows_) = linear_A_*x;
+
+  for (auto& data : nonlinear_) {
+    int n = data.evaluator->num_constraints();
+    int num_vars = data.var_indices.size();
+    for (int j = 0; j < num_vars; j++) {
+      data.x(j).value() = x(data.var_indices[j]);
+    }
+    data.evaluator->Eval(data.x, data.y);
+    for (int i = 0; i < n; i++) {
+      y_(data.row_start + i) = data.y(i).value();
+      // constant outputs may come back without derivatives
+      if (data.y(i).derivatives().size() == num_vars) {
+        values_.segment(data.value_start + i*num_vars, num_vars) = data.y(i).derivatives();
+      } else {
+        values_.segment(data.value_start + i*num_vars, num_vars).setZero();
+      }
+    }
+  }
+
+  updateJacobianValues();
+}
+
+void SparseLinearization::updateFiniteDifference(const Eigen::Ref<const VectorXd>& x, double dx) {
+  DRAKE_ASSERT(x.size() == num_vars_);
+  y_.head(num_linear_rows_) = linear_A_*x;
+
+  for (auto& data : nonlinear_) {
+    int n = data.evaluator->num_constraints();
+    int num_vars = data.var_indices.size();
+    for (int j = 0; j < num_vars; j++) {
+      data.x_double(j) = x(data.var_indices[j]);
+    }
+    data.evaluator->Eval(data.x_double, data.y0);
+    y_.segment(data.row_start, n) = data.y0;
+    values_.segment(data.value_start, n*num_vars).setZero();
+  }
+
+  // one evaluation of the program per color, with all of its variables
+  // perturbed; no binding has two variables of one color
+  for (int color = 0; color < num_colors(); color++) {
+    for (auto& data : nonlinear_) {
+      int n = data.evaluator->num_constraints();
+      int num_vars = data.var_indices.size();
+      for (int j = 0; j < num_vars; j++) {
+        if (color_[data.var_indices[j]] == color)
+          data.x_double(j) += dx;
+      }
+      data.evaluator->Eval(data.x_double, data.y_perturbed);
+      for (int j = 0; j < num_vars; j++) {
+        if (color_[data.var_indices[j]] == color) {
+          data.x_double(j) = x(data.var_indices[j]);
+          if (data.first_occurrence[j]) {
+            for (int i = 0; i < n; i++) {
+              values_(data.value_start + i*num_vars + j) = (data.y_perturbed(i) - data.y0(i))/dx;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  updateJacobianValues();
+}
+
+void SparseLinearization::updateJacobianValues() {
+  double* jacobian_values = jacobian_.valuePtr();
+  std::fill(jacobian_values, jacobian_values + jacobian_.nonZeros(), 0.0);
+  for (int i = 0; i < num_nonzeros(); i++) {
+    jacobian_values[jacobian_index_[i]] += values_(i);
+  }
+}
+
+namespace {
+
+// Adds the storage of an evaluator to usage, unless it is in counted
+void addEvaluatorMemory(const std::shared_ptr<solvers::EvaluatorBase>& evaluator,
+    std::set<const solvers::EvaluatorBase*>* counted, std::map<std::string, size_t>* usage) {
+  if (!counted->insert(evaluator.get()).second) {
+    return;
+  }
+  if (auto constraint = std::dynamic_pointer_cast<Constraint>(evaluator)) {
+    (*usage)["constraint bounds"] += (constraint->lower_bound().size() + constraint->upper_bound().size())*sizeof(double);
+  }
+  if (auto linear = std::dynamic_pointer_cast<solvers::LinearConstraint>(evaluator)) {
+    (*usage)["linear constraint matrices"] += linear->A().size()*sizeof(double);
+  }
+  if (auto lorentz = std::dynamic_pointer_cast<solvers::LorentzConeConstraint>(evaluator)) {
+    (*usage)["linear constraint matrices"] += (lorentz->A().size() + lorentz->b().size())*sizeof(double);
+  }
+  if (auto linear_cost = std::dynamic_pointer_cast<solvers::LinearCost>(evaluator)) {
+    (*usage)["cost coefficients"] += linear_cost->a().size()*sizeof(double);
+  }
+  if (auto quadratic_cost = std::dynamic_pointer_cast<solvers::QuadraticCost>(evaluator)) {
+    (*usage)["cost coefficients"] += (quadratic_cost->Q().size() + quadratic_cost->b().size())*sizeof(double);
+  }
+  if (auto dircon_double = std::dynamic_pointer_cast<DirconAbstractConstraint<double>>(evaluator)) {
+    (*usage)["dircon constraints"] += dircon_double->getMemoryUsage();
+  }
+  if (auto dircon_autodiff = std::dynamic_pointer_cast<DirconAbstractConstraint<AutoDiffXd>>(evaluator)) {
+    (*usage)["dircon constraints"] += dircon_autodiff->getMemoryUsage();
+  }
+  if (auto counting = std::dynamic_pointer_cast<DirconCountingConstraint>(evaluator)) {
+    (*usage)["evaluation statistics"] += sizeof(DirconEvaluationStatistics);
+    addEvaluatorMemory(counting->constraint(), counted, usage);
+  }
+}
+
+template <typename Derived>
+void addBindingMemory(const std::vector<Binding<Derived>>& bindings,
+    std::set<const solvers::EvaluatorBase*>* counted, std::map<std::string, size_t>* usage) {
+  for (auto const& binding : bindings) {
+    (*usage)["binding variables"] += sizeof(Binding<Derived>) + binding.variables().size()*sizeof(symbolic::Variable);
+    addEvaluatorMemory(binding.evaluator(), counted, usage);
+  }
+}
+
+}
+
+std::map<std::string, size_t> programMemoryUsage(const solvers::MathematicalProgram* prog) {
+  std::map<std::string, size_t> usage;
+  const solvers::VectorXDecisionVariable variables = prog->decision_variables();
+  for (int i = 0; i < variables.size(); i++) {
+    // the variable and its name, an entry of the index map, the guess and the solution
+    usage["decision variables"] += sizeof(symbolic::Variable) + sizeof(std::string) + variables(i).get_name().size() +
+                                   sizeof(size_t) + sizeof(int) + 2*sizeof(void*) + 2*sizeof(double);
+  }
+
+  std::set<const solvers::EvaluatorBase*> counted;
+  addBindingMemory(prog->bounding_box_constraints(), &counted, &usage);
+  addBindingMemory(prog->linear_constraints(), &counted, &usage);
+  addBindingMemory(prog->linear_equality_constraints(), &counted, &usage);
+  addBindingMemory(prog->lorentz_cone_constraints(), &counted, &usage);
+  addBindingMemory(prog->generic_constraints(), &counted, &usage);
+  addBindingMemory(prog->GetAllCosts(), &counted, &usage);
+  return usage;
+}
+
+size_t peakResidentSetSize() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      std::istringstream fields(line.substr(6));
+      size_t kilobytes = 0;
+      fields >> kilobytes;
+      return 1024*kilobytes;
+    }
+  }
+  return 0;
+}
+
 VectorXd NVec(int start, int length) {
   VectorXd ret(length);
   for (int i = 0; i < length; i++) {
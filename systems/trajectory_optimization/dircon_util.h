@@ -1,7 +1,13 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <Eigen/Sparse>
 #include "drake/solvers/mathematical_program.h"
 #include "drake/solvers/decision_variable.h"
 #include "drake/math/autodiff.h"
 #include "drake/math/autodiff_gradient.h"
+#include "dircon_opt_constraints.h"
 
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
@@ -24,6 +30,124 @@ void linearizeConstraints(const solvers::MathematicalProgram* prog, VectorXd& x,
 double secondOrderCost(const solvers::MathematicalProgram* prog, VectorXd& x,
   MatrixXd& Q, VectorXd& w);
 
+// Hessian of lambda^T*y(x), summed over all constraints, where lambda is
+// ordered by constraint row as in linearizeConstraints. Each binding's term
+// is approximated by central differences of its AutoDiff gradients (see
+// DirconAbstractConstraint::EvalLagrangianHessian), so DIRCON constraints
+// with T = double are not supported and throw.
+void secondOrderLagrangian(const solvers::MathematicalProgram* prog, VectorXd& x,
+  VectorXd& lambda, MatrixXd& H);
+
+/// Persistent sparse linearization of all constraints in a program, in the
+/// same row order as linearizeConstraints (bounding box, linear, linear
+/// equality, Lorentz cone, generic).
+/// The sparsity pattern, bounds and variable indices are computed once at
+/// construction, and the constant entries of the linear constraints are filled
+/// in then. update() only re-evaluates the nonlinear constraints and writes
+/// their values into the existing storage, so it can serve as the constraint
+/// callback of an external NLP solver. Jacobian entries are in triplet form
+/// (rows(), cols(), values()); repeated (row, col) pairs are to be summed.
+/// The program must not gain constraints after construction.
+class SparseLinearization {
+  public:
+    explicit SparseLinearization(const solvers::MathematicalProgram* prog);
+
+    /// Evaluates y(x) and the nonlinear Jacobian entries at x
+    void update(const Eigen::Ref<const VectorXd>& x);
+
+    /// As update(), but computes the nonlinear Jacobian entries with colored
+    /// (Curtis-Powell-Reid) forward differences. Variables that share no
+    /// nonlinear constraint row are perturbed together, and each color is one
+    /// evaluation of the whole program, so the cost is num_colors() + 1
+    /// program evaluations rather than num_vars() + 1, whatever the number of
+    /// knots. Each binding is evaluated at every one of these points, which is
+    /// at least as often as differencing it on its own (its number of
+    /// variables + 1), so this saves work only over differencing the program
+    /// as a whole, not over the per-binding differences of update() with
+    /// double constraints. Intended for double constraints, which are
+    /// evaluated without AutoDiff.
+    void updateFiniteDifference(const Eigen::Ref<const VectorXd>& x, double dx = 1e-8);
+
+    /// Number of groups of structurally independent variables
+    int num_colors() const { return color_columns_.size(); }
+
+    int num_constraints() const { return num_constraints_; }
+    int num_vars() const { return num_vars_; }
+    int num_nonzeros() const { return rows_.size(); }
+
+    const VectorXd& y() const { return y_; }
+    const VectorXd& lb() const { return lb_; }
+    const VectorXd& ub() const { return ub_; }
+    const std::vector<int>& rows() const { return rows_; }
+    const std::vector<int>& cols() const { return cols_; }
+    const VectorXd& values() const { return values_; }
+
+    /// The Jacobian as a compressed sparse matrix, refreshed by update()
+    const Eigen::SparseMatrix<double>& jacobian() const { return jacobian_; }
+
+  private:
+    struct BindingData {
+      std::shared_ptr<Constraint> evaluator;
+      std::vector<int> var_indices;
+      int row_start;
+      int value_start;
+      // derivatives are seeded once, only the values change per update
+      AutoDiffVecXd x;
+      AutoDiffVecXd y;
+      // storage for updateFiniteDifference
+      VectorXd x_double;
+      VectorXd y0;
+      VectorXd y_perturbed;
+      // false for repeated variables, whose entries are left at zero
+      std::vector<bool> first_occurrence;
+    };
+
+    void colorColumns();
+    void updateJacobianValues();
+
+    template <typename Derived>
+    void addLinear(const std::vector<Binding<Derived>>& constraints, std::vector<double>* values);
+    template <typename Derived>
+    void addNonlinear(const std::vector<Binding<Derived>>& constraints, std::vector<double>* values);
+
+    const solvers::MathematicalProgram* prog_;
+    int num_constraints_;
+    int num_vars_;
+    // constant rows A*x, stored row-major for the y evaluation
+    Eigen::SparseMatrix<double, Eigen::RowMajor> linear_A_;
+    int num_linear_rows_;
+    std::vector<BindingData> nonlinear_;
+    VectorXd y_;
+    VectorXd lb_;
+    VectorXd ub_;
+    std::vector<int> rows_;
+    std::vector<int> cols_;
+    VectorXd values_;
+    Eigen::SparseMatrix<double> jacobian_;
+    // position of each triplet in jacobian_.valuePtr()
+    std::vector<int> jacobian_index_;
+    // color of each variable, and the variables of each color
+    std::vector<int> color_;
+    std::vector<std::vector<int>> color_columns_;
+};
+
+/// Approximate heap memory held by a program, in bytes, by category:
+///   "decision variables": the variables, their names, index map, guess and solution
+///   "binding variables": the variable list of each binding
+///   "constraint bounds": the bounds of each constraint
+///   "linear constraint matrices": A of the linear, bounding box and Lorentz cone constraints
+///   "cost coefficients": the coefficients of the linear and quadratic costs
+///   "dircon constraints": see DirconAbstractConstraint::getMemoryUsage
+///   "evaluation statistics": the per-binding counters, if enabled
+/// Evaluators shared by several bindings are counted once. Excludes the
+/// solver's own storage, e.g. the Jacobian of linearizeConstraints, which is
+/// dense (rows x num_vars doubles), unlike SparseLinearization.
+std::map<std::string, size_t> programMemoryUsage(const solvers::MathematicalProgram* prog);
+
+/// The peak resident set size of the process in bytes (VmHWM in
+/// /proc/self/status), or 0 where this is unavailable
+size_t peakResidentSetSize();
+
 template <typename Derived>
 int countConstraints(const solvers::MathematicalProgram* prog, const std::vector<Binding<Derived>>& constraints);
 
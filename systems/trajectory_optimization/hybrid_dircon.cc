@@ -1,11 +1,16 @@
 #include "hybrid_dircon.h"
+#include "dircon_trace.h"
+#include "dircon_util.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <stdexcept>
 #include <utility>
 #include <vector>
 
 #include "drake/solvers/decision_variable.h"
+#include "drake/solvers/snopt_solver.h"
 #include "drake/math/autodiff.h"
 #include "drake/math/autodiff_gradient.h"
 
@@ -26,11 +31,19 @@ using std::vector;
 template <typename T>
 HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num_time_samples, vector<double> minimum_timestep,
   vector<double> maximum_timestep, vector<DirconKinematicDataSet<T>*> constraints, vector<DirconOptions> options)
+    : HybridDircon(tree, num_time_samples, minimum_timestep, maximum_timestep, constraints, options, true) {}
+
+template <typename T>
+HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num_time_samples, vector<double> minimum_timestep,
+  vector<double> maximum_timestep, vector<DirconKinematicDataSet<T>*> constraints, vector<DirconOptions> options,
+  bool equal_timesteps)
     : MultipleShooting(tree.get_num_actuators(), tree.get_num_positions() + tree.get_num_velocities(), 
       std::accumulate(num_time_samples.begin(), num_time_samples.end(),0) - num_time_samples.size() + 1, 1e-8, 1e8),
       num_modes_(num_time_samples.size()),
       v_post_impact_vars_(NewContinuousVariables(tree.get_num_velocities() * (num_time_samples.size() - 1), "v_p")),
       mode_lengths_(num_time_samples) {
+  DIRCON_TRACE_SCOPE("HybridDircon::HybridDircon");
+  solve_control_ = std::make_shared<DirconSolveControl>();
 
   DRAKE_ASSERT(minimum_timestep.size() == num_modes_);
   DRAKE_ASSERT(maximum_timestep.size() == num_modes_);
@@ -50,25 +63,65 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
     for (int j = 0; j < mode_lengths_[i] - 1; j++) {
       AddBoundingBoxConstraint(minimum_timestep[i], maximum_timestep[i], timestep(mode_start_[i] + j));
     }
-    for (int j = 0; j < mode_lengths_[i] - 2; j++) {
+    for (int j = 0; equal_timesteps && j < mode_lengths_[i] - 2; j++) {
       AddLinearConstraint(timestep(mode_start_[i] + j) == timestep(mode_start_[i] + j + 1)); //all timesteps must be equal
     }
 
     //initialize constraint lengths
     num_kinematic_constraints_.push_back(constraints_[i]->countConstraints());
+    constraints_relative_.push_back(options[i].getConstraintsRelative());
 
     //initialize decision variables
-    force_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * num_time_samples[i], "lambda[" + std::to_string(i) + "]"));
-    collocation_force_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * (num_time_samples[i] - 1), "lambda_c[" + std::to_string(i) + "]"));
-    collocation_slack_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * (num_time_samples[i] - 1), "v_c[" + std::to_string(i) + "]"));
+    if (options[i].getKnotInterleavedForces()) {
+      // Same vectors as below, but created knot by knot so that the variables
+      // of each interval are adjacent in the program
+      const int n_l = constraints_[i]->countConstraints();
+      VectorXDecisionVariable lambda(n_l * num_time_samples[i]);
+      VectorXDecisionVariable lambda_c(n_l * (num_time_samples[i] - 1));
+      VectorXDecisionVariable v_c(n_l * (num_time_samples[i] - 1));
+      for (int j = 0; j < num_time_samples[i]; j++) {
+        // named by mode and knot, e.g. lambda[0][3](1)
+        const std::string index = "[" + std::to_string(i) + "][" + std::to_string(j) + "]";
+        lambda.segment(j * n_l, n_l) = NewContinuousVariables(n_l, "lambda" + index);
+        if (j < num_time_samples[i] - 1) {
+          lambda_c.segment(j * n_l, n_l) = NewContinuousVariables(n_l, "lambda_c" + index);
+          v_c.segment(j * n_l, n_l) = NewContinuousVariables(n_l, "v_c" + index);
+        }
+      }
+      force_vars_.push_back(lambda);
+      collocation_force_vars_.push_back(lambda_c);
+      collocation_slack_vars_.push_back(v_c);
+    } else {
+      force_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * num_time_samples[i], "lambda[" + std::to_string(i) + "]"));
+      collocation_force_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * (num_time_samples[i] - 1), "lambda_c[" + std::to_string(i) + "]"));
+      collocation_slack_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints() * (num_time_samples[i] - 1), "v_c[" + std::to_string(i) + "]"));
+    }
     offset_vars_.push_back(NewContinuousVariables(options[i].getNumRelative(), "offset[" + std::to_string(i) + "]"));
     if (i > 0) {
       impulse_vars_.push_back(NewContinuousVariables(constraints_[i]->countConstraints(), "impulse[" + std::to_string(i) + "]"));
     }
+    const bool inverse_dynamics = options[i].getInverseDynamics();
+    const bool counted = options[i].getEvaluationStatistics();
+    const int nv = tree.get_num_velocities();
+    if (inverse_dynamics) {
+      acceleration_vars_.push_back(NewContinuousVariables(nv * num_time_samples[i], "vdot[" + std::to_string(i) + "]"));
+      collocation_acceleration_vars_.push_back(NewContinuousVariables(nv * (num_time_samples[i] - 1), "vdot_c[" + std::to_string(i) + "]"));
+    } else {
+      acceleration_vars_.push_back(VectorXDecisionVariable(0));
+      collocation_acceleration_vars_.push_back(VectorXDecisionVariable(0));
+    }
 
-    auto constraint = std::make_shared<DirconDynamicConstraint<T>>(tree, *constraints_[i]);
-
-    DRAKE_ASSERT(static_cast<int>(constraint->num_constraints()) == num_states());
+    // only the dynamic constraint of the mode's formulation is built
+    std::shared_ptr<DirconDynamicConstraint<T>> constraint;
+    std::shared_ptr<DirconInverseDynamicConstraint<T>> inverse_constraint;
+    if (inverse_dynamics) {
+      inverse_constraint = std::make_shared<DirconInverseDynamicConstraint<T>>(tree, *constraints_[i]);
+      inverse_constraint->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
+    } else {
+      constraint = std::make_shared<DirconDynamicConstraint<T>>(tree, *constraints_[i]);
+      constraint->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
+      DRAKE_ASSERT(static_cast<int>(constraint->num_constraints()) == num_states());
+    }
 
     // For N-1 timesteps, add a constraint which depends on the knot
     // value along with the state and input vectors at that knot and the
@@ -106,7 +159,21 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
       //                collocation_force_vars(i).segment(j * num_kinematic_constraints(i), num_kinematic_constraints(i)),
       //                collocation_slack_vars(i).segment(j * num_kinematic_constraints(i), num_kinematic_constraints(i))});
 
-      AddConstraint(constraint,
+      if (inverse_dynamics) {
+        // The knot dynamics are imposed with the kinematic constraints below
+        AddCountedConstraint(inverse_constraint, "inverse_dynamic", i, j, counted,
+                      {h_vars().segment(time_index,1),
+                       state_vars_by_mode(i, j),
+                       state_vars_by_mode(i, j+1),
+                       u_vars().segment(time_index * num_inputs(), num_inputs() * 2),
+                       acceleration_vars(i).segment(j * nv, nv * 2),
+                       collocation_force_vars(i).segment(j * num_kinematic_constraints(i), num_kinematic_constraints(i)),
+                       collocation_slack_vars(i).segment(j * num_kinematic_constraints(i), num_kinematic_constraints(i)),
+                       collocation_acceleration_vars(i).segment(j * nv, nv)});
+        continue;
+      }
+
+      AddCountedConstraint(constraint, "dynamic", i, j, counted,
                     {h_vars().segment(time_index,1),
                      state_vars_by_mode(i, j),
                      state_vars_by_mode(i, j+1),
@@ -118,35 +185,46 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
       // std::cout << "Constraining " << state_vars_by_mode(i,j) << " to " << state_vars_by_mode(i,j+1) << std::endl;
     }
 
-    //Adding kinematic constraints
+    //Adding kinematic constraints. With inverse dynamics, these also carry the
+    //dynamics residual at the knot, in terms of the knot acceleration
+    auto knot_accelerations = [&](int j) {
+      return inverse_dynamics ? VectorXDecisionVariable(acceleration_vars(i).segment(j * nv, nv))
+                              : VectorXDecisionVariable(0);
+    };
     auto kinematic_constraint = std::make_shared<DirconKinematicConstraint<T>>(tree, *constraints_[i],
-      options[i].getConstraintsRelative());
+      options[i].getConstraintsRelative(), DirconKinConstraintType::kAll, inverse_dynamics);
+    kinematic_constraint->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
     for (int j = 1; j < mode_lengths_[i] - 1; j++) {
       int time_index = mode_start_[i] + j;
-      AddConstraint(kinematic_constraint,
+      AddCountedConstraint(kinematic_constraint, "kinematic", i, j, counted,
                     {state_vars_by_mode(i,j),
                      u_vars().segment(time_index * num_inputs(), num_inputs()),
                      force_vars(i).segment(j * num_kinematic_constraints(i), num_kinematic_constraints(i)),
-                     offset_vars(i)});
+                     offset_vars(i),
+                     knot_accelerations(j)});
     }
 
     //special case first and last tiemstep based on options
     auto kinematic_constraint_start = std::make_shared<DirconKinematicConstraint<T>>(tree, *constraints_[i],
-      options[i].getConstraintsRelative(), options[i].getStartType());
-    AddConstraint(kinematic_constraint_start,
+      options[i].getConstraintsRelative(), options[i].getStartType(), inverse_dynamics);
+    kinematic_constraint_start->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
+    AddCountedConstraint(kinematic_constraint_start, "kinematic", i, 0, counted,
                   {state_vars_by_mode(i,0),
                    u_vars().segment(mode_start_[i], num_inputs()),
                    force_vars(i).segment(0, num_kinematic_constraints(i)),
-                   offset_vars(i)});
+                   offset_vars(i),
+                   knot_accelerations(0)});
 
 
     auto kinematic_constraint_end = std::make_shared<DirconKinematicConstraint<T>>(tree, *constraints_[i],
-      options[i].getConstraintsRelative(), options[i].getEndType());
-    AddConstraint(kinematic_constraint_end,
+      options[i].getConstraintsRelative(), options[i].getEndType(), inverse_dynamics);
+    kinematic_constraint_end->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
+    AddCountedConstraint(kinematic_constraint_end, "kinematic", i, mode_lengths_[i] - 1, counted,
                   {state_vars_by_mode(i, mode_lengths_[i] - 1),
                    u_vars().segment((mode_start_[i] + mode_lengths_[i] - 1) * num_inputs(), num_inputs()),
                    force_vars(i).segment((mode_lengths_[i]-1) * num_kinematic_constraints(i), num_kinematic_constraints(i)),
-                   offset_vars(i)});
+                   offset_vars(i),
+                   knot_accelerations(mode_lengths_[i] - 1)});
 
 
     //Add constraints on force and impulse variables
@@ -156,7 +234,8 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
         DirconKinematicData<T>* constraint_j = constraints_[i]->getConstraint(j);
         start_index += constraint_j->getLength();
         for (int k = 0; k < constraint_j->numForceConstraints(); k++) {
-          AddConstraint(constraint_j->getForceConstraint(k), force_vars(i).segment(start_index, constraint_j->getLength()));
+          AddCountedConstraint(constraint_j->getForceConstraint(k), "friction", i, l, counted,
+                               {force_vars(i).segment(start_index, constraint_j->getLength())});
         }
       }
     }
@@ -173,7 +252,8 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
     if (i > 0) {
       if (num_kinematic_constraints(i) > 0) {
         auto impact_constraint = std::make_shared<DirconImpactConstraint<T>>(tree, *constraints_[i]);
-        AddConstraint(impact_constraint,
+        impact_constraint->setFiniteDifference(options[i].getFiniteDifferenceType(), options[i].getFiniteDifferenceStep());
+        AddCountedConstraint(impact_constraint, "impact", i, 0, counted,
                 {state_vars_by_mode(i-1, mode_lengths_[i-1] - 1), // last state from previous mode
                  impulse_vars(i-1),
                  v_post_impact_vars_by_mode(i-1)});
@@ -183,7 +263,8 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
         for (int j = 0; j < constraints_[i]->getNumConstraintObjects(); j++) {
           DirconKinematicData<T>* constraint_j = constraints_[i]->getConstraint(j);
           for (int k = 0; k < constraint_j->numForceConstraints(); k++) {
-            AddConstraint(constraint_j->getForceConstraint(k), impulse_vars(i-1).segment(start_index, constraint_j->getLength()));
+            AddCountedConstraint(constraint_j->getForceConstraint(k), "friction", i, 0, counted,
+                                 {impulse_vars(i-1).segment(start_index, constraint_j->getLength())});
           }
           start_index += constraint_j->getLength();
         }
@@ -198,6 +279,116 @@ HybridDircon<T>::HybridDircon(const RigidBodyTree<double>& tree, vector<int> num
   }
 }
 
+template <typename T>
+void HybridDircon<T>::AddCountedConstraint(std::shared_ptr<Constraint> constraint, const std::string& type,
+                                           int mode, int knot, bool counted, const solvers::VariableRefList& vars) {
+  auto dircon_constraint = std::dynamic_pointer_cast<DirconAbstractConstraint<T>>(constraint);
+  if (dircon_constraint) {
+    dircon_constraint->setSolveControl(solve_control_);
+    solve_control_->addBinding();
+  }
+  // linear constraints are never evaluated by the solver, and must stay linear
+  if (!counted || std::dynamic_pointer_cast<solvers::LinearConstraint>(constraint)) {
+    AddConstraint(constraint, vars);
+    return;
+  }
+  auto statistics = std::make_shared<DirconEvaluationStatistics>();
+  statistics->type = type;
+  statistics->mode = mode;
+  statistics->knot = knot;
+  evaluation_statistics_.push_back(statistics);
+  AddConstraint(std::make_shared<DirconCountingConstraint>(constraint, statistics), vars);
+}
+
+template <typename T>
+std::future<solvers::SolutionResult> HybridDircon<T>::SolveAsync(int iterations_per_check) {
+  // reset before returning, so a CancelSolve() that follows is not lost
+  solve_control_->reset();
+  return std::async(std::launch::async, [this, iterations_per_check]() {
+    // The total major iteration limit: the user's, or SNOPT's default of
+    // max(1000, 3m) for m general constraint rows
+    const auto& snopt_options = GetSolverOptionsInt(solvers::SnoptSolver::id());
+    const auto limit_option = snopt_options.find("Major iterations limit");
+    const bool limit_set = limit_option != snopt_options.end();
+    int num_rows = 0;
+    num_rows += dircon::countConstraints(this, linear_constraints());
+    num_rows += dircon::countConstraints(this, linear_equality_constraints());
+    num_rows += dircon::countConstraints(this, lorentz_cone_constraints());
+    num_rows += dircon::countConstraints(this, generic_constraints());
+    const int iteration_limit = limit_set ? limit_option->second : std::max(1000, 3*num_rows);
+    const int segment = iterations_per_check > 0 ? iterations_per_check : iteration_limit;
+    const VectorXd initial_guess = this->initial_guess();
+
+    // Each segment ends through the solver's own iteration limit, and the
+    // next one warm starts from its result
+    solvers::SolutionResult result = solvers::kIterationLimit;
+    int iterations = 0;
+    while (result == solvers::kIterationLimit && iterations < iteration_limit && !solve_control_->isCancelled()) {
+      const int segment_limit = std::min(segment, iteration_limit - iterations);
+      SetSolverOption(solvers::SnoptSolver::id(), "Major iterations limit", segment_limit);
+      if (iterations > 0) {
+        SetInitialGuessForAllVariables(GetSolution(decision_variables()));
+      }
+      result = Solve();
+      iterations += segment_limit;
+    }
+    if (result == solvers::kIterationLimit && iterations < iteration_limit) {
+      solve_control_->recordCancellation();
+    }
+
+    // MathematicalProgram cannot remove a solver option, so a limit the user
+    // never set is left at the value SNOPT would use by default
+    SetSolverOption(solvers::SnoptSolver::id(), "Major iterations limit", iteration_limit);
+    SetInitialGuessForAllVariables(initial_guess);
+    return result;
+  });
+}
+
+template <typename T>
+vector<DirconEvaluationStatistics> HybridDircon<T>::GetEvaluationStatistics() const {
+  vector<DirconEvaluationStatistics> statistics;
+  for (auto const& binding_statistics : evaluation_statistics_) {
+    statistics.push_back(*binding_statistics);
+  }
+  return statistics;
+}
+
+template <typename T>
+void HybridDircon<T>::ResetEvaluationStatistics() {
+  for (auto const& statistics : evaluation_statistics_) {
+    statistics->value_evaluations = 0;
+    statistics->gradient_evaluations = 0;
+    statistics->value_time = 0;
+    statistics->gradient_time = 0;
+  }
+}
+
+template <typename T>
+void HybridDircon<T>::WriteEvaluationStatisticsCsv(std::ostream& out) const {
+  out << "type,mode,knot,value_evaluations,gradient_evaluations,value_time,gradient_time" << std::endl;
+  const auto precision = out.precision(9);
+  for (auto const& statistics : evaluation_statistics_) {
+    out << statistics->type << "," << statistics->mode << "," << statistics->knot << "," <<
+        statistics->value_evaluations << "," << statistics->gradient_evaluations << "," <<
+        statistics->value_time << "," << statistics->gradient_time << std::endl;
+  }
+  out.precision(precision);
+}
+
+template <typename T>
+std::map<std::string, size_t> HybridDircon<T>::GetMemoryUsage() const {
+  std::map<std::string, size_t> usage = dircon::programMemoryUsage(this);
+  size_t num_variables = v_post_impact_vars_.size();
+  for (auto const* mode_vars : {&force_vars_, &collocation_force_vars_, &collocation_slack_vars_, &offset_vars_,
+                                &impulse_vars_, &acceleration_vars_, &collocation_acceleration_vars_}) {
+    for (auto const& vars : *mode_vars) {
+      num_variables += vars.size();
+    }
+  }
+  usage["dircon variable vectors"] = num_variables*sizeof(symbolic::Variable);
+  return usage;
+}
+
 template <typename T>
 const Eigen::VectorBlock<const solvers::VectorXDecisionVariable> HybridDircon<T>::v_post_impact_vars_by_mode(int mode) const {
   return v_post_impact_vars_.segment(mode * tree_->get_num_velocities(), tree_->get_num_velocities());
@@ -234,6 +425,7 @@ solvers::VectorXDecisionVariable HybridDircon<T>::state_vars_by_mode(int mode, i
 //TODO: need to configure this to handle the hybrid discontinuities properly
 template <typename T>
 void HybridDircon<T>::DoAddRunningCost(const symbolic::Expression& g) {
+  DIRCON_TRACE_SCOPE("HybridDircon::DoAddRunningCost");
   // Trapezoidal integration:
   //    sum_{i=0...N-2} h_i/2.0 * (g_i + g_{i+1}), or
   // g_0*h_0/2.0 + [sum_{i=1...N-2} g_i*(h_{i-1} + h_i)/2.0] +
@@ -284,13 +476,185 @@ PiecewisePolynomial<double> HybridDircon<T>::ReconstructStateTrajectory()
       states[k] = GetSolution(state_vars_by_mode(i, j));
       inputs[k] = GetSolution(input(k_data));
       forces[k] = GetSolution(force(i, j));
-      constraints_[i]->updateData(states[k], inputs[k], forces[k]);
-      derivatives[k] = math::DiscardGradient(constraints_[i]->getXDot());
+      if (acceleration_vars_[i].size() > 0) {
+        // the knot accelerations of the inverse-dynamics formulation define the spline
+        const int nv = tree_->get_num_velocities();
+        derivatives[k] = VectorXd(num_states());
+        derivatives[k] << states[k].bottomRows(nv), GetSolution(acceleration_vars_[i].segment(j*nv, nv));
+      } else {
+        constraints_[i]->updateData(VectorX<T>(states[k].template cast<T>()), VectorX<T>(inputs[k].template cast<T>()),
+                                    VectorX<T>(forces[k].template cast<T>()));
+        derivatives[k] = math::DiscardGradient(constraints_[i]->getXDot());
+      }
   }
 }
   return PiecewisePolynomial<double>::Cubic(times_vec, states, derivatives);
 }
 
+template <typename T>
+Binding<solvers::LinearEqualityConstraint> HybridDircon<T>::AddPeriodicityConstraint(const MatrixXd& map,
+                                                                                    const VectorXd& offset) {
+  DRAKE_DEMAND(map.rows() == num_states() && map.cols() == num_states());
+  periodicity_map_ = map;
+  periodicity_offset_ = offset.size() > 0 ? offset : VectorXd::Zero(num_states());
+  DRAKE_DEMAND(periodicity_offset_.size() == num_states());
+
+  // map*x_0 - x_f = -offset
+  MatrixXd A(num_states(), 2*num_states());
+  A << map, -MatrixXd::Identity(num_states(), num_states());
+  VectorXDecisionVariable vars(2*num_states());
+  vars << initial_state(), final_state();
+  return AddLinearEqualityConstraint(A, -periodicity_offset_, vars);
+}
+
+template <typename T>
+Binding<solvers::LinearEqualityConstraint> HybridDircon<T>::AddPeriodicityConstraint(const vector<int>& permutation,
+                                                                                    const vector<double>& sign,
+                                                                                    const VectorXd& offset) {
+  DRAKE_DEMAND(static_cast<int>(permutation.size()) == num_states());
+  DRAKE_DEMAND(static_cast<int>(sign.size()) == num_states());
+  MatrixXd map = MatrixXd::Zero(num_states(), num_states());
+  for (int i = 0; i < num_states(); i++) {
+    map(i, permutation[i]) = sign[i];
+  }
+  return AddPeriodicityConstraint(map, offset);
+}
+
+template <typename T>
+PiecewisePolynomial<double> HybridDircon<T>::MapStateTrajectory(const PiecewisePolynomial<double>& traj) const {
+  DRAKE_DEMAND(periodicity_map_.size() > 0);
+  const vector<double>& times = traj.get_segment_times();
+  vector<MatrixXd> states(times.size());
+  for (size_t i = 0; i < times.size(); i++) {
+    states[i] = periodicity_map_*traj.value(times[i]) + periodicity_offset_;
+  }
+  return PiecewisePolynomial<double>::FirstOrderHold(times, states);
+}
+
+template <typename T>
+VectorXd HybridDircon<T>::ConsistentForces(int mode, const VectorXd& x, const VectorXd& u, VectorXd* xdot) {
+  // With lambda = 0, cddot_0 = Jdotv + J*M^{-1}*(Bu - C). The forces add
+  // J*M^{-1}*J^T*lambda, so lambda = -(J*M^{-1}*J^T)^{-1}*cddot_0
+  const int n_l = num_kinematic_constraints_[mode];
+  constraints_[mode]->updateData(x.template cast<T>(), u.template cast<T>(), VectorX<T>::Zero(n_l));
+  const MatrixXd J = math::DiscardGradient(constraints_[mode]->getJ());
+  const MatrixXd M = math::DiscardGradient(constraints_[mode]->getM());
+  const VectorXd cddot = math::DiscardGradient(constraints_[mode]->getCDDot());
+  const MatrixXd A = J*M.llt().solve(J.transpose());
+  const VectorXd lambda = -A.completeOrthogonalDecomposition().solve(cddot);
+
+  constraints_[mode]->updateData(x.template cast<T>(), u.template cast<T>(), lambda.template cast<T>());
+  *xdot = math::DiscardGradient(constraints_[mode]->getXDot());
+  return lambda;
+}
+
+template <typename T>
+void HybridDircon<T>::ProjectInitialGuess(int max_iterations, double tolerance) {
+  const int nq = tree_->get_num_positions();
+  const int nv = tree_->get_num_velocities();
+  auto guess = [this](const Eigen::Ref<const VectorXDecisionVariable>& vars) {
+    VectorXd value = GetInitialGuess(vars);
+    return VectorXd(value.unaryExpr([](double v) { return std::isnan(v) ? 0 : v; }));
+  };
+
+  // c(q) targets of each mode. Relative constraints are c(q) + offset = 0,
+  // so their target is minus the offset guess
+  vector<VectorXd> targets(num_modes_);
+  for (int i = 0; i < num_modes_; i++) {
+    targets[i] = VectorXd::Zero(num_kinematic_constraints_[i]);
+    const VectorXd offsets = guess(offset_vars_[i]);
+    for (int k = 0, l = 0; k < num_kinematic_constraints_[i]; k++) {
+      if (constraints_relative_[i][k]) {
+        targets[i](k) = -offsets(l++);
+      }
+    }
+  }
+
+  // Newton projection (minimum-norm steps in v, mapped to q) of the q of every
+  // knot, before any forces are computed. The last knot of a mode and the
+  // first of the next share q, so it is projected once, onto the constraints
+  // of both modes.
+  vector<VectorXd> positions(N());
+  for (int k = 0; k < N(); k++) {
+    vector<int> modes;
+    int n_rows = 0;
+    for (int i = 0; i < num_modes_; i++) {
+      if (num_kinematic_constraints_[i] > 0 && k >= mode_start_[i] && k < mode_start_[i] + mode_lengths_[i]) {
+        modes.push_back(i);
+        n_rows += num_kinematic_constraints_[i];
+      }
+    }
+    VectorXd x = guess(state(k));
+    const VectorXd u = guess(input(k));
+    for (int iteration = 0; iteration < max_iterations && n_rows > 0; iteration++) {
+      VectorXd residual(n_rows);
+      MatrixXd J(n_rows, nv);
+      int row = 0;
+      for (int i : modes) {
+        const int n_l = num_kinematic_constraints_[i];
+        constraints_[i]->updateData(x.template cast<T>(), u.template cast<T>(), VectorX<T>::Zero(n_l));
+        residual.segment(row, n_l) = math::DiscardGradient(constraints_[i]->getC()) - targets[i];
+        J.middleRows(row, n_l) = math::DiscardGradient(constraints_[i]->getJ());
+        row += n_l;
+      }
+      if (residual.lpNorm<Eigen::Infinity>() < tolerance) {
+        break;
+      }
+      const VectorXd dv = J.completeOrthogonalDecomposition().solve(residual);
+      if (constraints_[modes.back()]->isQDotIdentity()) {
+        x.head(nq) -= dv;
+      } else {
+        x.head(nq) -= math::DiscardGradient(tree_->GetVelocityToQDotMapping(*constraints_[modes.back()]->getCache()))*dv;
+      }
+    }
+    positions[k] = x.head(nq);
+  }
+
+  for (int i = 0; i < num_modes_; i++) {
+    const int n_l = num_kinematic_constraints_[i];
+    if (n_l == 0) {
+      continue;
+    }
+
+    vector<VectorXd> states(mode_lengths_[i]);
+    vector<VectorXd> inputs(mode_lengths_[i]);
+    vector<VectorXd> derivatives(mode_lengths_[i]);
+    for (int j = 0; j < mode_lengths_[i]; j++) {
+      VectorXd x = guess(state_vars_by_mode(i, j));
+      x.head(nq) = positions[mode_start_[i] + j];
+      inputs[j] = guess(input(mode_start_[i] + j));
+      const VectorXd zero_force = VectorXd::Zero(n_l);
+
+      // v onto the null space of J, so that cdot = J*v = 0
+      constraints_[i]->updateData(x.template cast<T>(), inputs[j].template cast<T>(), zero_force.template cast<T>());
+      const MatrixXd J = math::DiscardGradient(constraints_[i]->getJ());
+      x.tail(nv) -= J.completeOrthogonalDecomposition().solve(J*x.tail(nv));
+
+      states[j] = x;
+      SetInitialGuess(state_vars_by_mode(i, j), x);
+      SetInitialGuess(force(i, j), ConsistentForces(i, x, inputs[j], &derivatives[j]));
+      if (acceleration_vars_[i].size() > 0) {
+        SetInitialGuess(acceleration_vars_[i].segment(j*nv, nv), derivatives[j].tail(nv));
+      }
+    }
+
+    // Collocation forces at the cubic interpolation of the projected knots
+    VectorXd guess_collocation_force(collocation_force_vars_[i].size());
+    for (int j = 0; j < mode_lengths_[i] - 1; j++) {
+      const double h = guess(h_vars().segment(mode_start_[i] + j, 1))(0);
+      const VectorXd xcol = 0.5*(states[j] + states[j+1]) + h/8*(derivatives[j] - derivatives[j+1]);
+      const VectorXd ucol = 0.5*(inputs[j] + inputs[j+1]);
+      VectorXd xdotcol;
+      guess_collocation_force.segment(j*n_l, n_l) = ConsistentForces(i, xcol, ucol, &xdotcol);
+      if (collocation_acceleration_vars_[i].size() > 0) {
+        SetInitialGuess(collocation_acceleration_vars_[i].segment(j*nv, nv), xdotcol.tail(nv));
+      }
+    }
+    SetInitialGuess(collocation_force_vars_[i], guess_collocation_force);
+    SetInitialGuess(collocation_slack_vars_[i], VectorXd::Zero(collocation_slack_vars_[i].size()));
+  }
+}
+
 template <typename T>
 void HybridDircon<T>::SetInitialForceTrajectory(int mode, const PiecewisePolynomial<double>& traj_init_l,
                                                 const PiecewisePolynomial<double>& traj_init_lc,
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <memory.h>
+#include <future>
+#include <map>
+#include <ostream>
+#include <string>
 #include "dircon_opt_constraints.h"
 #include "dircon_options.h"
+#include "dircon_solve_control.h"
 #include "dircon_kinematic_data.h"
 #include "dircon_kinematic_data_set.h"
 #include "drake/common/drake_copyable.h"
@@ -39,6 +44,8 @@ class HybridDircon : public MultipleShooting {
   DRAKE_NO_COPY_NO_MOVE_NO_ASSIGN(HybridDircon)
 
   /// Constructs the %MathematicalProgram% and adds the collocation constraints.
+  /// The timesteps within each mode are tied equal by linear equalities;
+  /// DirconPresolve substitutes them by one variable per mode.
   ///
   /// @param tree The RigidBodyTree describing the plant and kinematics
   /// @param num_time_samples The number of knot points in the trajectory.
@@ -51,6 +58,15 @@ class HybridDircon : public MultipleShooting {
 
   ~HybridDircon() override {}
 
+ protected:
+  /// As above, but with @p equal_timesteps false the timesteps within each
+  /// mode are left independent (see Dircon)
+  HybridDircon(const RigidBodyTree<double>& tree, vector<int> num_time_samples, vector<double> minimum_timestep,
+    vector<double> maximum_timestep, vector<DirconKinematicDataSet<T>*> constraints, vector<DirconOptions> options,
+    bool equal_timesteps);
+
+ public:
+
   /// Get the input trajectory at the solution as a
   /// %PiecewisePolynomialTrajectory%.
   PiecewisePolynomial<double> ReconstructInputTrajectory()
@@ -72,6 +88,84 @@ class HybridDircon : public MultipleShooting {
 
 
 
+  /// Add the periodicity constraint x_f = map*x_0 + offset between the initial
+  /// and final states of the trajectory, as a single linear equality binding.
+  /// The map and offset are kept for MapStateTrajectory.
+  /// @param map the num_states x num_states map
+  /// @param offset the offset. If empty, zero
+  solvers::Binding<solvers::LinearEqualityConstraint> AddPeriodicityConstraint(const Eigen::MatrixXd& map,
+      const Eigen::VectorXd& offset = Eigen::VectorXd());
+
+  /// As above, for the signed permutation x_f(i) = sign[i]*x_0(permutation[i]) + offset(i)
+  solvers::Binding<solvers::LinearEqualityConstraint> AddPeriodicityConstraint(const vector<int>& permutation,
+      const vector<double>& sign, const Eigen::VectorXd& offset = Eigen::VectorXd());
+
+  /// Apply the periodicity map x -> map*x + offset to a state trajectory,
+  /// sampled at its segment times, e.g. to warm start the mirrored step from
+  /// the solution of this one
+  PiecewisePolynomial<double> MapStateTrajectory(const PiecewisePolynomial<double>& traj) const;
+
+  /// Project the current initial guess onto the constraint manifolds of each
+  /// mode. At every knot, q is Newton-projected (minimum-norm steps) onto
+  /// c(q) = 0 (c(q) + offset = 0 at the offset guess, for relative
+  /// constraints), and v onto the null space of J. The q of a knot shared by
+  /// two modes is projected once, onto the constraints of both, before the
+  /// forces of either mode are computed. The knot forces are then
+  /// set so that the constrained dynamics satisfy cddot = 0, and likewise
+  /// the collocation forces at the interpolated collocation states, with
+  /// zero velocity slack.
+  /// Unset (NaN) guesses are treated as zero.
+  /// @param max_iterations the maximum number of Newton steps per knot
+  /// @param tolerance the constraint violation at which to stop
+  void ProjectInitialGuess(int max_iterations = 10, double tolerance = 1e-10);
+
+  /// The evaluation counts and times of each nonlinear binding in the modes
+  /// with DirconOptions::setEvaluationStatistics, in the order the bindings
+  /// were added. Counts accumulate over solves until
+  /// ResetEvaluationStatistics().
+  vector<DirconEvaluationStatistics> GetEvaluationStatistics() const;
+
+  void ResetEvaluationStatistics();
+
+  /// Write GetEvaluationStatistics() as CSV, one row per binding, with a
+  /// header row. Times are in seconds.
+  void WriteEvaluationStatisticsCsv(std::ostream& out) const;
+
+  /// Approximate heap memory held by the program, in bytes, by category (see
+  /// dircon::programMemoryUsage), with the copies of the decision variable
+  /// vectors held by HybridDircon under "dircon variable vectors"
+  std::map<std::string, size_t> GetMemoryUsage() const;
+
+  /// Solve() on a separate thread, in segments of @p iterations_per_check
+  /// SNOPT major iterations that can be cancelled between them. Each
+  /// segment ends through SNOPT's own iteration limit and the next is warm
+  /// started from its solution, up to the program's "Major iterations
+  /// limit" in total (if unset, SNOPT's default of max(1000, 3m) for m
+  /// general constraint rows). Restarts discard SNOPT's quasi-Newton
+  /// Hessian approximation, so smaller segments trade convergence for
+  /// cancellation latency; with @p iterations_per_check <= 0 the solve runs
+  /// in one segment and can only be cancelled before it starts. Other
+  /// solvers ignore the SNOPT limit and run in one segment.
+  ///
+  /// The returned future holds the result of the last segment
+  /// (kIterationLimit when cancelled; solve_control().isCancelled() tells
+  /// the cases apart), and the solution is that of the last segment. The
+  /// initial guess and iteration limit are restored afterwards; an unset
+  /// limit is left at SNOPT's default for this program, since options cannot
+  /// be removed from a MathematicalProgram. Progress
+  /// may be read from solve_control() while the solve runs. The program must
+  /// not be modified, solved again, or destroyed until the future is ready.
+  std::future<solvers::SolutionResult> SolveAsync(int iterations_per_check = 20);
+
+  /// Requests that the solve started by SolveAsync() stop at the end of its
+  /// current segment; see DirconSolveControl::getCancellationLatency().
+  /// Plain Solve() calls are never cancelled. Safe to call from any thread.
+  void CancelSolve() { solve_control_->cancel(); }
+
+  /// Progress of the current (or last) solve. The DIRCON constraints report
+  /// to it during any solve, not only SolveAsync().
+  const DirconSolveControl& solve_control() const { return *solve_control_; }
+
   int num_kinematic_constraints(int mode) const { return num_kinematic_constraints_[mode]; }
 
   const solvers::VectorXDecisionVariable& force_vars(int mode) const { return force_vars_[mode]; }
@@ -82,6 +176,15 @@ class HybridDircon : public MultipleShooting {
 
   const solvers::VectorXDecisionVariable& collocation_slack_vars(int mode) const { return collocation_slack_vars_[mode]; }
 
+  /// The knot accelerations of a mode using the inverse-dynamics formulation
+  /// (see DirconOptions::setInverseDynamics), empty otherwise
+  const solvers::VectorXDecisionVariable& acceleration_vars(int mode) const { return acceleration_vars_[mode]; }
+
+  /// The collocation point accelerations of an inverse-dynamics mode, empty otherwise
+  const solvers::VectorXDecisionVariable& collocation_acceleration_vars(int mode) const {
+    return collocation_acceleration_vars_[mode];
+  }
+
   const solvers::VectorXDecisionVariable& v_post_impact_vars() const { return v_post_impact_vars_; }
 
   const solvers::VectorXDecisionVariable& impulse_vars(int mode) const {return impulse_vars_[mode]; }
@@ -112,13 +215,27 @@ class HybridDircon : public MultipleShooting {
   vector<int> mode_start_;
   vector<DirconKinematicDataSet<T>*> constraints_;
   void DoAddRunningCost(const symbolic::Expression& e) override;
+  // AddConstraint, through a DirconCountingConstraint if counted is set
+  // (linear constraints are added directly)
+  void AddCountedConstraint(std::shared_ptr<solvers::Constraint> constraint, const std::string& type,
+                            int mode, int knot, bool counted, const solvers::VariableRefList& vars);
+  // The knot forces for which cddot = 0 at (x, u), and the resulting xdot
+  Eigen::VectorXd ConsistentForces(int mode, const Eigen::VectorXd& x, const Eigen::VectorXd& u,
+                                   Eigen::VectorXd* xdot);
   const solvers::VectorXDecisionVariable v_post_impact_vars_;
   vector<solvers::VectorXDecisionVariable> force_vars_;
   vector<solvers::VectorXDecisionVariable> collocation_force_vars_;
   vector<solvers::VectorXDecisionVariable> collocation_slack_vars_;
   vector<solvers::VectorXDecisionVariable> offset_vars_;
   vector<solvers::VectorXDecisionVariable> impulse_vars_;
+  vector<solvers::VectorXDecisionVariable> acceleration_vars_;
+  vector<solvers::VectorXDecisionVariable> collocation_acceleration_vars_;
   vector<int> num_kinematic_constraints_;
+  vector<vector<bool>> constraints_relative_;
+  vector<std::shared_ptr<DirconEvaluationStatistics>> evaluation_statistics_;
+  std::shared_ptr<DirconSolveControl> solve_control_;
+  Eigen::MatrixXd periodicity_map_;
+  Eigen::VectorXd periodicity_offset_;
 };
 
 }  // namespace trajectory_optimization
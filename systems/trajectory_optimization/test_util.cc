@@ -5,6 +5,7 @@
 
 using drake::systems::trajectory_optimization::dircon::checkConstraints;
 using drake::systems::trajectory_optimization::dircon::linearizeConstraints;
+using drake::systems::trajectory_optimization::dircon::SparseLinearization;
 using std::cout;
 using std::endl;
 
@@ -44,4 +45,15 @@ int main(int argc, char* argv[]) {
   cout << "*************A***************" << endl;
   cout << A << endl;
 
-}
\ No newline at end of file
+  SparseLinearization sparse(&prog);
+  sparse.update(z);
+  cout << "*************sparse nonzeros***************" << endl;
+  cout << sparse.num_nonzeros() << endl;
+  cout << "*************sparse error (f, A)***************" << endl;
+  cout << (sparse.y() - f).norm() << " " << (MatrixXd(sparse.jacobian()) - A).norm() << endl;
+
+  sparse.updateFiniteDifference(z);
+  cout << "*************colored differences (colors, f error, A error)***************" << endl;
+  cout << sparse.num_colors() << " " << (sparse.y() - f).norm() << " " <<
+      (MatrixXd(sparse.jacobian()) - A).norm() << endl;
+}
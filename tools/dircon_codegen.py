@@ -0,0 +1,480 @@
+#!/usr/bin/env python
+"""Generates robot-specific dynamics kernels for DIRCON from a URDF.
+
+The generated class implements DirconDynamicsBackend<T> with the joint
+geometry and link inertias folded into constants and all spatial quantities
+stored in fixed-size Eigen matrices. The mass matrix is computed with an
+unrolled composite rigid body algorithm and the bias term with an unrolled
+recursive Newton-Euler pass, so no virtual joints, dynamic allocation or
+tree traversal remain. The kernels are templated on the scalar type, and the
+AutoDiffXd instantiation provides their derivatives.
+
+Only the mass matrix and bias term are generated. The contact kinematics
+(DirconPositionData) and doKinematics still use the RigidBodyTree.
+
+Supports fixed, revolute, continuous and prismatic joints on a robot whose
+root link is welded to the world (drake::multibody::joints::kFixed).
+
+Usage:
+  dircon_codegen.py <robot.urdf> <ClassName> <output_basename>
+which writes <output_basename>.h and <output_basename>.cc
+"""
+
+from __future__ import print_function
+
+import math
+import os
+import sys
+import xml.etree.ElementTree as ET
+
+GRAVITY = 9.81
+
+
+# Small dense matrix helpers, so that the tool has no dependencies
+def zeros(n, m):
+  return [[0.0] * m for _ in range(n)]
+
+
+def eye(n):
+  ret = zeros(n, n)
+  for i in range(n):
+    ret[i][i] = 1.0
+  return ret
+
+
+def matmul(a, b):
+  return [[sum(a[i][k] * b[k][j] for k in range(len(b)))
+           for j in range(len(b[0]))] for i in range(len(a))]
+
+
+def matvec(a, x):
+  return [sum(a[i][k] * x[k] for k in range(len(x))) for i in range(len(a))]
+
+
+def transpose(a):
+  return [list(row) for row in zip(*a)]
+
+
+def add(a, b):
+  return [[a[i][j] + b[i][j] for j in range(len(a[0]))] for i in range(len(a))]
+
+
+def scale(a, s):
+  return [[s * x for x in row] for row in a]
+
+
+def skew(p):
+  return [[0.0, -p[2], p[1]],
+          [p[2], 0.0, -p[0]],
+          [-p[1], p[0], 0.0]]
+
+
+def rpy_to_rotation(rpy):
+  r, p, y = rpy
+  rx = [[1, 0, 0], [0, math.cos(r), -math.sin(r)], [0, math.sin(r), math.cos(r)]]
+  ry = [[math.cos(p), 0, math.sin(p)], [0, 1, 0], [-math.sin(p), 0, math.cos(p)]]
+  rz = [[math.cos(y), -math.sin(y), 0], [math.sin(y), math.cos(y), 0], [0, 0, 1]]
+  return matmul(rz, matmul(ry, rx))
+
+
+def block6(a, b, c, d):
+  return [a[i] + b[i] for i in range(3)] + [c[i] + d[i] for i in range(3)]
+
+
+def motion_transform(rotation, position):
+  """Transform of motion vectors from frame A to frame B coordinates, where
+  B has orientation rotation and origin position expressed in A."""
+  e = transpose(rotation)
+  return block6(e, zeros(3, 3), scale(matmul(e, skew(position)), -1.0), e)
+
+
+def spatial_inertia(mass, com, inertia):
+  c = skew(com)
+  upper_left = add(inertia, scale(matmul(c, transpose(c)), mass))
+  return block6(upper_left, scale(c, mass), scale(transpose(c), mass),
+                scale(eye(3), mass))
+
+
+def parse_vector(text, default):
+  if text is None:
+    return list(default)
+  return [float(x) for x in text.split()]
+
+
+def parse_origin(element):
+  origin = element.find('origin') if element is not None else None
+  if origin is None:
+    return eye(3), [0.0, 0.0, 0.0]
+  return (rpy_to_rotation(parse_vector(origin.get('rpy'), [0, 0, 0])),
+          parse_vector(origin.get('xyz'), [0, 0, 0]))
+
+
+class Link(object):
+  def __init__(self, element):
+    self.name = element.get('name')
+    self.inertia = zeros(6, 6)
+    inertial = element.find('inertial')
+    if inertial is not None:
+      rotation, com = parse_origin(inertial)
+      mass = float(inertial.find('mass').get('value'))
+      i = inertial.find('inertia')
+      get = lambda key: float(i.get(key, 0))
+      rotational = [[get('ixx'), get('ixy'), get('ixz')],
+                    [get('ixy'), get('iyy'), get('iyz')],
+                    [get('ixz'), get('iyz'), get('izz')]]
+      rotational = matmul(rotation, matmul(rotational, transpose(rotation)))
+      self.inertia = spatial_inertia(mass, com, rotational)
+
+
+class Joint(object):
+  def __init__(self, element):
+    self.name = element.get('name')
+    self.type = element.get('type')
+    self.parent = element.find('parent').get('link')
+    self.child = element.find('child').get('link')
+    self.rotation, self.position = parse_origin(element)
+    axis = element.find('axis')
+    self.axis = parse_vector(axis.get('xyz') if axis is not None else None,
+                             [1, 0, 0])
+    norm = math.sqrt(sum(a * a for a in self.axis))
+    self.axis = [a / norm for a in self.axis]
+    dynamics = element.find('dynamics')
+    self.damping = 0.0
+    if dynamics is not None:
+      self.damping = float(dynamics.get('damping', 0))
+      if float(dynamics.get('friction', 0)) != 0:
+        raise ValueError('Coulomb friction is not supported: ' + self.name)
+    if self.type not in ('fixed', 'revolute', 'continuous', 'prismatic'):
+      raise ValueError('Unsupported joint type ' + self.type + ': ' + self.name)
+
+
+class Body(object):
+  """A movable body: a link with a one degree of freedom joint, together
+  with all links welded to it."""
+  def __init__(self, joint, parent, rotation, position):
+    self.joint = joint
+    self.parent = parent
+    # Pose of the joint frame (before joint motion) in the parent body frame
+    self.rotation = rotation
+    self.position = position
+    self.inertia = zeros(6, 6)
+
+
+def build_bodies(urdf):
+  root = ET.parse(urdf).getroot()
+  # Drop any xml namespace, as used by the drake URDF extensions
+  for element in root.iter():
+    element.tag = element.tag.split('}')[-1]
+  links = [Link(e) for e in root.findall('link')]
+  joints = dict((j.child, j) for j in (Joint(e) for e in root.findall('joint')))
+  roots = [l for l in links if l.name not in joints]
+  if len(roots) != 1:
+    raise ValueError('Expected a single root link')
+
+  # Stable topological sort over the document order of the links, which
+  # matches the body (and so coordinate) ordering of RigidBodyTree
+  ordered = []
+  placed = set()
+  while len(ordered) < len(links):
+    progress = False
+    for link in links:
+      if link.name in placed:
+        continue
+      if link.name not in joints or joints[link.name].parent in placed:
+        ordered.append(link)
+        placed.add(link.name)
+        progress = True
+    if not progress:
+      raise ValueError('Links do not form a tree')
+
+  bodies = []
+  # For each link, the index of its body (-1 for the world) and its pose in
+  # that body's frame
+  link_body = {}
+  for link in ordered:
+    if link.name not in joints:
+      link_body[link.name] = (-1, eye(3), [0.0, 0.0, 0.0])
+      continue
+    joint = joints[link.name]
+    parent, parent_rotation, parent_position = link_body[joint.parent]
+    rotation = matmul(parent_rotation, joint.rotation)
+    position = [parent_position[i] + x for i, x in
+                enumerate(matvec(parent_rotation, joint.position))]
+    if joint.type == 'fixed':
+      link_body[link.name] = (parent, rotation, position)
+    else:
+      bodies.append(Body(joint, parent, rotation, position))
+      link_body[link.name] = (len(bodies) - 1, eye(3), [0.0, 0.0, 0.0])
+
+  for link in ordered:
+    body, rotation, position = link_body[link.name]
+    if body < 0:
+      continue
+    x = motion_transform(rotation, position)
+    bodies[body].inertia = add(bodies[body].inertia,
+                               matmul(transpose(x), matmul(link.inertia, x)))
+  return root.get('name'), bodies
+
+
+def literal(x):
+  if abs(x) < 1e-15:
+    return '0'
+  return repr(float(x))
+
+
+def matrix_literal(a):
+  return ', '.join(literal(x) for row in a for x in row)
+
+
+def vector_literal(x):
+  return ', '.join(literal(v) for v in x)
+
+
+def motion_subspace(joint):
+  if joint.type == 'prismatic':
+    return [0.0, 0.0, 0.0] + joint.axis
+  return joint.axis + [0.0, 0.0, 0.0]
+
+
+def generate_transform(i, body):
+  """Code computing X_i, the motion transform from the parent body to body
+  i, with the joint origin folded into constants."""
+  a = body.joint.axis
+  lines = ['  // ' + body.joint.name + ' (' + body.joint.type + ')']
+  if body.joint.type == 'prismatic':
+    lines.append('  {')
+    lines.append('    const Vector3<T> p = kPosition%d.cast<T>() + kRotation%d.cast<T>()*(q(%d)*kAxis%d.cast<T>());' % (i, i, i, i))
+    lines.append('    X%d = motionTransform<T>(kRotation%d.transpose().cast<T>(), p);' % (i, i))
+    lines.append('  }')
+  else:
+    # Rodrigues' formula with the constant axis: R = I + s*K + (1 - c)*K^2
+    k = skew(a)
+    k2 = matmul(k, k)
+    lines.append('  {')
+    lines.append('    using std::cos;')
+    lines.append('    using std::sin;')
+    lines.append('    const T s = sin(q(%d));' % i)
+    lines.append('    const T c1 = 1.0 - cos(q(%d));' % i)
+    lines.append('    Matrix3<T> R;')
+    entries = []
+    for r in range(3):
+      for c in range(3):
+        terms = []
+        if r == c:
+          terms.append('1.0')
+        if k[r][c] != 0:
+          terms.append('%s*s' % literal(k[r][c]))
+        if k2[r][c] != 0:
+          terms.append('%s*c1' % literal(k2[r][c]))
+        entries.append('T(' + (' + '.join(terms) if terms else '0') + ')')
+    lines.append('    R << ' + ', '.join(entries) + ';')
+    lines.append('    X%d = motionTransform<T>((kRotation%d.cast<T>()*R).transpose(), kPosition%d.cast<T>());' % (i, i, i))
+    lines.append('  }')
+  return lines
+
+
+HEADER = '''// Generated by tools/dircon_codegen.py from {urdf}. Do not edit.
+#pragma once
+
+#include <array>
+
+#include "drake/multibody/rigid_body_tree.h"
+#include "systems/trajectory_optimization/dircon_dynamics_backend.h"
+
+namespace drake {{
+
+/// Fixed-size dynamics kernels for the {robot} robot
+template <typename T>
+class {cls} : public DirconDynamicsBackend<T> {{
+  public:
+    static constexpr int kNumPositions = {n};
+
+    /// Checks that the coordinates of @p tree match the generated kernels
+    explicit {cls}(const RigidBodyTree<double>& tree);
+
+    void massMatrix(const Eigen::Ref<const VectorX<T>>& q, Eigen::Ref<MatrixX<T>> M) override;
+    void dynamicsBiasTerm(const Eigen::Ref<const VectorX<T>>& q, const Eigen::Ref<const VectorX<T>>& v,
+                          Eigen::Ref<VectorX<T>> bias) override;
+
+    Eigen::Matrix<T, {n}, {n}> calcMassMatrix(const Eigen::Matrix<T, {n}, 1>& q) const;
+    Eigen::Matrix<T, {n}, 1> calcBiasTerm(const Eigen::Matrix<T, {n}, 1>& q,
+                                          const Eigen::Matrix<T, {n}, 1>& v) const;
+
+  private:
+    void calcTransforms(const Eigen::Matrix<T, {n}, 1>& q,
+                        std::array<Eigen::Matrix<T, 6, 6>, {n}>* X) const;
+}};
+
+}}
+'''
+
+
+def generate(urdf, cls, basename):
+  robot, bodies = build_bodies(urdf)
+  n = len(bodies)
+  include = os.path.basename(basename) + '.h'
+
+  with open(basename + '.h', 'w') as f:
+    f.write(HEADER.format(urdf=os.path.basename(urdf), robot=robot, cls=cls, n=n))
+
+  out = []
+  w = out.append
+  w('// Generated by tools/dircon_codegen.py from %s. Do not edit.' % os.path.basename(urdf))
+  w('#include "%s"' % include)
+  w('')
+  w('#include <array>')
+  w('#include <cmath>')
+  w('')
+  w('namespace drake {')
+  w('namespace {')
+  w('')
+  w('using Matrix6d = Eigen::Matrix<double, 6, 6>;')
+  w('using Vector6d = Eigen::Matrix<double, 6, 1>;')
+  w('template <typename T> using Matrix6 = Eigen::Matrix<T, 6, 6>;')
+  w('template <typename T> using Vector6 = Eigen::Matrix<T, 6, 1>;')
+  w('')
+  w('const char* kPositionNames[] = {%s};' %
+    ', '.join('"%s"' % b.joint.name for b in bodies))
+  w('')
+  for i, b in enumerate(bodies):
+    w('const Eigen::Matrix3d kRotation%d = (Eigen::Matrix3d() << %s).finished();' % (i, matrix_literal(b.rotation)))
+    w('const Eigen::Vector3d kPosition%d(%s);' % (i, vector_literal(b.position)))
+    w('const Eigen::Vector3d kAxis%d(%s);' % (i, vector_literal(b.joint.axis)))
+    w('const Vector6d kS%d = (Vector6d() << %s).finished();' % (i, vector_literal(motion_subspace(b.joint))))
+    w('const Matrix6d kInertia%d = (Matrix6d() << %s).finished();' % (i, matrix_literal(b.inertia)))
+    w('')
+  w('// Motion vector transform for a frame with orientation E^T and origin p')
+  w('template <typename T>')
+  w('Matrix6<T> motionTransform(const Matrix3<T>& E, const Vector3<T>& p) {')
+  w('  Matrix3<T> p_cross;')
+  w('  p_cross << T(0), -p(2), p(1),')
+  w('              p(2), T(0), -p(0),')
+  w('             -p(1), p(0), T(0);')
+  w('  Matrix6<T> X;')
+  w('  X << E, Matrix3<T>::Zero(), -E*p_cross, E;')
+  w('  return X;')
+  w('}')
+  w('')
+  w('// Spatial cross product for motion vectors, v x m')
+  w('template <typename T>')
+  w('Vector6<T> crossMotion(const Vector6<T>& v, const Vector6<T>& m) {')
+  w('  Vector6<T> ret;')
+  w('  ret << v.template head<3>().cross(m.template head<3>()),')
+  w('         v.template head<3>().cross(m.template tail<3>()) +')
+  w('         v.template tail<3>().cross(m.template head<3>());')
+  w('  return ret;')
+  w('}')
+  w('')
+  w('// Spatial cross product for force vectors, v x* f')
+  w('template <typename T>')
+  w('Vector6<T> crossForce(const Vector6<T>& v, const Vector6<T>& f) {')
+  w('  Vector6<T> ret;')
+  w('  ret << v.template head<3>().cross(f.template head<3>()) +')
+  w('         v.template tail<3>().cross(f.template tail<3>()),')
+  w('         v.template head<3>().cross(f.template tail<3>());')
+  w('  return ret;')
+  w('}')
+  w('')
+  w('}  // namespace')
+  w('')
+  w('template <typename T>')
+  w('%s<T>::%s(const RigidBodyTree<double>& tree) {' % (cls, cls))
+  w('  DRAKE_DEMAND(tree.get_num_positions() == kNumPositions);')
+  w('  DRAKE_DEMAND(tree.get_num_velocities() == kNumPositions);')
+  w('  for (int i = 0; i < kNumPositions; i++) {')
+  w('    DRAKE_DEMAND(tree.get_position_name(i) == kPositionNames[i]);')
+  w('  }')
+  w('}')
+  w('')
+  w('template <typename T>')
+  w('void %s<T>::calcTransforms(const Eigen::Matrix<T, %d, 1>& q,' % (cls, n))
+  w('    std::array<Eigen::Matrix<T, 6, 6>, %d>* X_out) const {' % n)
+  w('  auto& X = *X_out;')
+  for i, b in enumerate(bodies):
+    for line in generate_transform(i, b):
+      w(line.replace('X%d =' % i, 'X[%d] =' % i))
+  w('}')
+  w('')
+
+  # Composite rigid body algorithm
+  w('template <typename T>')
+  w('Eigen::Matrix<T, %d, %d> %s<T>::calcMassMatrix(const Eigen::Matrix<T, %d, 1>& q) const {' % (n, n, cls, n))
+  w('  std::array<Matrix6<T>, %d> X;' % n)
+  w('  calcTransforms(q, &X);')
+  for i in range(n):
+    w('  Matrix6<T> Ic%d = kInertia%d.cast<T>();' % (i, i))
+  for i in reversed(range(n)):
+    p = bodies[i].parent
+    if p >= 0:
+      w('  Ic%d += X[%d].transpose()*Ic%d*X[%d];' % (p, i, i, i))
+  w('  Eigen::Matrix<T, %d, %d> H = Eigen::Matrix<T, %d, %d>::Zero();' % (n, n, n, n))
+  w('  Vector6<T> F;')
+  for i in range(n):
+    w('  F = Ic%d*kS%d.cast<T>();' % (i, i))
+    w('  H(%d, %d) = kS%d.cast<T>().dot(F);' % (i, i, i))
+    j = i
+    while bodies[j].parent >= 0:
+      w('  F = X[%d].transpose()*F;' % j)
+      j = bodies[j].parent
+      w('  H(%d, %d) = kS%d.cast<T>().dot(F);' % (i, j, j))
+      w('  H(%d, %d) = H(%d, %d);' % (j, i, i, j))
+  w('  return H;')
+  w('}')
+  w('')
+
+  # Recursive Newton-Euler with zero acceleration
+  w('template <typename T>')
+  w('Eigen::Matrix<T, %d, 1> %s<T>::calcBiasTerm(const Eigen::Matrix<T, %d, 1>& q,' % (n, cls, n))
+  w('    const Eigen::Matrix<T, %d, 1>& v) const {' % n)
+  w('  std::array<Matrix6<T>, %d> X;' % n)
+  w('  calcTransforms(q, &X);')
+  w('  // Gravity enters as an upward acceleration of the world')
+  w('  Vector6<T> a_world = Vector6<T>::Zero();')
+  w('  a_world(5) = T(%s);' % literal(GRAVITY))
+  for i, b in enumerate(bodies):
+    p = b.parent
+    if p >= 0:
+      w('  const Vector6<T> v%d = X[%d]*v%d + kS%d.cast<T>()*v(%d);' % (i, i, p, i, i))
+      w('  const Vector6<T> a%d = X[%d]*a%d + crossMotion<T>(v%d, kS%d.cast<T>()*v(%d));' % (i, i, p, i, i, i))
+    else:
+      w('  const Vector6<T> v%d = kS%d.cast<T>()*v(%d);' % (i, i, i))
+      w('  const Vector6<T> a%d = X[%d]*a_world;' % (i, i))
+    w('  Vector6<T> f%d = kInertia%d.cast<T>()*a%d + crossForce<T>(v%d, kInertia%d.cast<T>()*v%d);' % (i, i, i, i, i, i))
+  w('  Eigen::Matrix<T, %d, 1> tau;' % n)
+  for i in reversed(range(n)):
+    b = bodies[i]
+    line = '  tau(%d) = kS%d.cast<T>().dot(f%d)' % (i, i, i)
+    if b.joint.damping != 0:
+      line += ' + %s*v(%d)' % (literal(b.joint.damping), i)
+    w(line + ';')
+    if b.parent >= 0:
+      w('  f%d += X[%d].transpose()*f%d;' % (b.parent, i, i))
+  w('  return tau;')
+  w('}')
+  w('')
+  w('template <typename T>')
+  w('void %s<T>::massMatrix(const Eigen::Ref<const VectorX<T>>& q, Eigen::Ref<MatrixX<T>> M) {' % cls)
+  w('  M = calcMassMatrix(q);')
+  w('}')
+  w('')
+  w('template <typename T>')
+  w('void %s<T>::dynamicsBiasTerm(const Eigen::Ref<const VectorX<T>>& q, const Eigen::Ref<const VectorX<T>>& v,' % cls)
+  w('    Eigen::Ref<VectorX<T>> bias) {')
+  w('  bias = calcBiasTerm(q, v);')
+  w('}')
+  w('')
+  w('// Explicitly instantiates on the most common scalar types.')
+  w('template class %s<double>;' % cls)
+  w('template class %s<AutoDiffXd>;' % cls)
+  w('')
+  w('}')
+
+  with open(basename + '.cc', 'w') as f:
+    f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+  if len(sys.argv) != 4:
+    print(__doc__)
+    sys.exit(1)
+  generate(sys.argv[1], sys.argv[2], sys.argv[3])